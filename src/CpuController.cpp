@@ -1,9 +1,13 @@
 #include "CpuController.h"
 
-volatile boolean CpuController::clockFalling = false;
-volatile boolean CpuController::clockRising = false;
+template <typename Model>
+volatile boolean BasicCpuController<Model>::clockFalling = false;
 
-void CpuController::init()
+template <typename Model>
+volatile boolean BasicCpuController<Model>::clockRising = false;
+
+template <typename Model>
+void BasicCpuController<Model>::init()
 {
     UCode.init();
 
@@ -13,7 +17,8 @@ void CpuController::init()
     reset();
 }
 
-void CpuController::cpuClockCallback() 
+template <typename Model>
+void BasicCpuController<Model>::cpuClockCallback() 
 {
     if (!digitalRead(CPU_CLOCK_PIN))
         clockFalling = true;
@@ -21,7 +26,8 @@ void CpuController::cpuClockCallback()
         clockRising = true;
 }
 
-void CpuController::initShiftRegisters()
+template <typename Model>
+void BasicCpuController<Model>::initShiftRegisters()
 {
     // Setup the pins connected to the shift registers
     pinMode(DATA_PIN, INPUT);
@@ -30,14 +36,16 @@ void CpuController::initShiftRegisters()
     pinMode(OUT_LATCH_PIN, OUTPUT);
 }
 
-void CpuController::initClockInterrupt()
+template <typename Model>
+void BasicCpuController<Model>::initClockInterrupt()
 {
     // Attach a pin interupt to the cpu clock rising edge
     pinMode(CPU_CLOCK_PIN, INPUT_PULLUP);
     attachInterrupt(digitalPinToInterrupt(CPU_CLOCK_PIN), cpuClockCallback, CHANGE);
 }
 
-void CpuController::reset()
+template <typename Model>
+void BasicCpuController<Model>::reset()
 {
     // Fetch the current instruction
     uint8_t instructionBuffer[1];
@@ -47,14 +55,39 @@ void CpuController::reset()
     instruction = instructionBuffer[0];
     instructionStep = 0;
 
+    // Abort the byte which is written into RAM and the jump to the start of the code
+    addressSetup = false;
+    startShifted = false;
+
+    // In overlay mode the program restarts with the first segment, so it gets paged in again
+    if (overlayMode && (paging || segment != 0))
+    {
+        // RAM holds bytes of two segments after an aborted paging, none of them can be skipped
+        if (!paging)
+            previousSegment = segment;
+        else if (segmentLoaded > 0)
+            previousInRam = false;
+
+        segment = 0;
+        segmentLoaded = 0;
+        paging = true;
+    }
+
+    // Programs start at address zero
+    estimatedPc = 0;
+
     // Set the current control word depending on the instruction, flags and step
     controlWord = UCode.getControlWord(instruction, flags, instructionStep);
 
     // Clear the last control word
     shiftOutControlBuffer(0x00, 0x00);
+
+    // The history only covers the current run, stepping back into another mode would mix up the steps
+    Emulator.clearHistory();
 }
 
-void CpuController::setLoadCodeMode(boolean loadCode)
+template <typename Model>
+void BasicCpuController<Model>::setLoadCodeMode(boolean loadCode)
 {
     if (executeMode)
         return;
@@ -63,7 +96,8 @@ void CpuController::setLoadCodeMode(boolean loadCode)
     loadCodeMode = loadCode;
 }
 
-void CpuController::setExecuteMode(boolean execute)
+template <typename Model>
+void BasicCpuController<Model>::setExecuteMode(boolean execute)
 {
     if (loadCodeMode)
         return;
@@ -72,8 +106,18 @@ void CpuController::setExecuteMode(boolean execute)
     executeMode = execute;
 }
 
-void CpuController::handleInstructions()
+template <typename Model>
+void BasicCpuController<Model>::handleInstructions()
 {
+    // The virtual cpu has no clock of its own, every call runs a full clock cycle until it halts or gets paused
+    if (virtualCpu)
+    {
+        if (!virtualPaused && (executeMode || loadCodeMode) && !Emulator.isHalted())
+            clockVirtualCpu();
+
+        return;
+    }
+
     // If there was no clock cylce detected return
     if (!clockFalling && !clockRising)
         return;
@@ -84,9 +128,7 @@ void CpuController::handleInstructions()
         // Reset the detected clock cylce
         clockFalling = false;
 
-        // Check the mode and execute its current instruction
-        if (executeMode) executeInstruction();
-        else if (loadCodeMode) executeLoadCode();
+        handleClockFalling();
     }
 
     // Handle rising clock
@@ -95,16 +137,59 @@ void CpuController::handleInstructions()
         // Reset the detected clock cylce
         clockRising = false;
 
-        // Set the ready flag when the clock is rising
-        if (executeMode) shiftOutControlBuffer(controlWord | C_RDY, 0x00);
+        handleClockRising();
+    }
+}
+
+template <typename Model>
+void BasicCpuController<Model>::handleClockFalling()
+{
+    // Check the mode and execute its current instruction
+    if (executeMode && paging) executePageSegment();
+    else if (executeMode) executeInstruction();
+    else if (loadCodeMode) executeLoadCode();
+}
+
+template <typename Model>
+void BasicCpuController<Model>::handleClockRising()
+{
+    // Set the ready flag when the clock is rising
+    if (executeMode && !paging) shiftOutControlBuffer(controlWord | C_RDY, 0x00);
+
+    // The cpu took the jump to the start of the loaded code, it can be executed now
+    else if (loadCodeMode && startShifted)
+    {
+        jumpToStart = false;
+        startShifted = false;
     }
 }
 
-void CpuController::executeInstruction()
+template <typename Model>
+void BasicCpuController<Model>::clockVirtualCpu()
+{
+    handleClockFalling();
+    handleClockRising();
+
+    // The registers of the cpu take the control word with the rising edge
+    Emulator.clock(instructionStep);
+
+    if (Emulator.takeBreakpointHit())
+        virtualPaused = true;
+}
+
+template <typename Model>
+void BasicCpuController<Model>::executeInstruction()
 {
-    // Reset the instruction step back to zero
-    if (instructionStep > UCode.MaxInstructionStep)
+    // Reset the instruction step back to zero after the last step of the current instruction
+    if (instructionStep >= UCode.getInstructionSteps(instruction))
+    {
+        Profile.recordInstruction(instruction, instructionStep);
         instructionStep = 0;
+    }
+
+    // Switch the microcode bank only between two instructions
+    if (instructionStep == 0 && pendingBank >= 0)
+        applyPendingBank();
 
     // Fetch the current instruction
     uint8_t instructionBuffer[2];
@@ -117,29 +202,87 @@ void CpuController::executeInstruction()
     // Set the current control word depending on the instruction, flags and step
     controlWord = UCode.getControlWord(instruction, flags, instructionStep);
 
+    cycleCount++;
+
+    // Keep the step for the trace readout
+    TraceEntry &entry = trace[traceIndex];
+    entry.instruction = instruction;
+    entry.flags = flags;
+    entry.step = instructionStep;
+    entry.controlWord = controlWord;
+
+    traceIndex = (traceIndex + 1) % MaxTraceEntries;
+
+    // Count the step and follow the program counter and memory address register through the values put on the bus
+    Profile.recordStep(instruction, flags, controlWord);
+
+    if (instructionStep == 0)
+        Profile.recordFetch(estimatedPc);
+
+    // Only the program counter and the RAM at the memory address are known, register values aren't followed
+    ControlWord busOutput = controlWord & C_EPO;
+    boolean busKnown = busOutput == C_CO || busOutput == C_RO;
+    uint8_t bus = busOutput == C_CO ? estimatedPc : getLoadedCode(estimatedMar);
+
+    if ((controlWord & C_MI) && busKnown)
+        estimatedMar = bus;
+
+    if (controlWord & C_JMP)
+    {
+        if (busKnown)
+            estimatedPc = bus;
+
+        Profile.recordJump();
+    }
+    else if (controlWord & C_CE)
+        estimatedPc = (estimatedPc + 1) & Model::AddressMask;
+
+    // Page in the next overlay segment instead of halting or executing the page instruction
+    if (overlayMode && ((instruction == PAG && instructionStep == 2) || (controlWord & C_HLT)) && beginPaging())
+    {
+        executePageSegment();
+        return;
+    }
+
     // Shift out the control word
     shiftOutControlBuffer(controlWord, 0x00);
 
     // Debug statement
-    Serial.print("Executed instruction!\n\tinstruction: 0x");
-    Serial.print(instruction, HEX);
-    Serial.print("; flags: ");
-    Serial.print(flags, BIN);
-    Serial.print("; step: ");
-    Serial.print(instructionStep, BIN);
-    Serial.print("\n\tcontrolWord: ");
-    Serial.print(controlWord, BIN);
-    Serial.println();
+    if (debugOutput)
+    {
+        Serial.print("Executed instruction!\n\tinstruction: 0x");
+        Serial.print(instruction, HEX);
+        Serial.print("; flags: ");
+        Serial.print(flags, BIN);
+        Serial.print("; step: ");
+        Serial.print(instructionStep, BIN);
+        Serial.print("\n\tcontrolWord: ");
+        Serial.print(controlWord, BIN);
+        Serial.println();
+    }
     
     // Increase the cpu instruction step
     instructionStep++;
 }
 
-void CpuController::executeLoadCode()
+template <typename Model>
+void BasicCpuController<Model>::executeLoadCode()
 {
     // Check if there is code left to load
     if (codeLoaded >= codeSize)
     {
+        // Let the program start at address zero, once all code is loaded, the jump is done with the rising clock edge
+        if (jumpToStart)
+        {
+            controlWord = C_EPO | C_JMP;
+            shiftOutControlBuffer(controlWord | C_RDY, 0x00);
+
+            startShifted = true;
+            estimatedPc = 0;
+
+            return;
+        }
+
         // No code left to load switch off registers
         controlWord = 0x00;
 
@@ -152,6 +295,33 @@ void CpuController::executeLoadCode()
     // Get the next code instruction to load
     codeToLoad = code[codeLoaded];
 
+    // Write the address into the MAR first and the code into RAM on the next clock pulse
+    if (shiftOutCodeByte(codeLoaded, codeToLoad))
+    {
+        // Debug statement
+        if (debugOutput)
+        {
+            Serial.print("Code loaded!\n\tcodeToLoad: 0x");
+            Serial.print(codeToLoad, HEX);
+            Serial.print(", 0b");
+            Serial.print(codeToLoad, BIN);
+            Serial.print("\n\tcodeLoaded: ");
+            Serial.print(codeLoaded);
+            Serial.print("\n\tcodeSize: ");
+            Serial.print(codeSize);
+            Serial.print("\n\tcontrolWord: ");
+            Serial.print(controlWord, BIN);
+            Serial.println();
+        }
+
+        // Increase the code loaded count
+        codeLoaded++;
+    }
+}
+
+template <typename Model>
+boolean BasicCpuController<Model>::shiftOutCodeByte(uint8_t address, uint8_t value)
+{
     // Check if the RAM address is already setup
     if (!addressSetup)
     {
@@ -159,67 +329,252 @@ void CpuController::executeLoadCode()
         controlWord = C_EPO | C_MI;
 
         // Shift out the control word and set the ready flag
-        shiftOutControlBuffer(controlWord | C_RDY, codeLoaded);
-        
+        shiftOutControlBuffer(controlWord | C_RDY, address);
+
         // Set the address setup flag
         addressSetup = true;
+
+        return false;
     }
-    else
+
+    // Write the value into RAM
+    controlWord = C_EPO | C_RI;
+
+    // Shift out the control word and set the ready flag
+    shiftOutControlBuffer(controlWord | C_RDY, value);
+
+    addressSetup = false;
+
+    return true;
+}
+
+template <typename Model>
+void BasicCpuController<Model>::executePageSegment()
+{
+    uint8_t *segmentCode = overlay + segment * segmentSize;
+    uint8_t *previousCode = overlay + previousSegment * segmentSize;
+
+    uint8_t length = getSegmentLength(segment);
+    uint8_t previousLength = getSegmentLength(previousSegment);
+
+    // Skip all bytes which are already in RAM, because the previous segment holds the same value at that address
+    while (previousInRam && !addressSetup && segmentLoaded < length && segmentLoaded < previousLength && segmentCode[segmentLoaded] == previousCode[segmentLoaded])
     {
-        // Write the code to load into RAM
-        controlWord = C_EPO | C_RI;
+        segmentLoaded++;
+        skippedBytes++;
+    }
 
-        // Shift out the control word and set the ready flag
-        shiftOutControlBuffer(controlWord | C_RDY, codeToLoad);
+    // Write the next differing byte into RAM
+    if (segmentLoaded < length)
+    {
+        if (shiftOutCodeByte(segmentLoaded, segmentCode[segmentLoaded]))
+        {
+            segmentLoaded++;
+            pagedBytes++;
+        }
 
-        // Debug statement
-        Serial.print("Code loaded!\n\tcodeToLoad: 0x");
-        Serial.print(codeToLoad, HEX);
-        Serial.print(", 0b");
-        Serial.print(codeToLoad, BIN);
-        Serial.print("\n\tcodeLoaded: ");
-        Serial.print(codeLoaded);
-        Serial.print("\n\tcodeSize: ");
-        Serial.print(codeSize);
-        Serial.print("\n\tcontrolWord: ");
-        Serial.print(controlWord, BIN);
+        return;
+    }
+
+    // Segment is loaded, jump to its start and resume execution with the next clock pulse
+    controlWord = C_EPO | C_JMP;
+    shiftOutControlBuffer(controlWord | C_RDY, 0x00);
+
+    paging = false;
+    instructionStep = 0;
+    estimatedPc = 0;
+
+    // Debug statement
+    if (debugOutput)
+    {
+        Serial.print("Segment paged!\n\tsegment: ");
+        Serial.print(segment);
+        Serial.print("; pagedBytes: ");
+        Serial.print(pagedBytes);
+        Serial.print("; skippedBytes: ");
+        Serial.print(skippedBytes);
         Serial.println();
+    }
+}
 
-        // Increase the code loaded count
-        addressSetup = false;
-        codeLoaded++;
+template <typename Model>
+uint8_t BasicCpuController<Model>::getLoadedCode(uint8_t address)
+{
+    // In overlay mode the RAM holds the current segment
+    if (overlayMode)
+        return address < getSegmentLength(segment) ? overlay[segment * segmentSize + address] : 0x00;
+
+    return address < codeSize ? code[address] : 0x00;
+}
+
+template <typename Model>
+boolean BasicCpuController<Model>::beginPaging()
+{
+    // Check if there is another segment left to page in
+    if ((uint32_t)(segment + 1) * segmentSize >= overlaySize)
+        return false;
+
+    previousSegment = segment;
+    segment++;
+
+    segmentLoaded = 0;
+    previousInRam = true;
+    addressSetup = false;
+    paging = true;
+
+    return true;
+}
+
+template <typename Model>
+uint8_t BasicCpuController<Model>::getSegmentLength(uint16_t index)
+{
+    uint16_t start = index * segmentSize;
+    if (start >= overlaySize)
+        return 0;
+
+    return std::min<uint16_t>(segmentSize, overlaySize - start);
+}
+
+template <typename Model>
+boolean BasicCpuController<Model>::writeOverlay(uint16_t offset, uint8_t buffer[], uint8_t size)
+{
+    // Parts have to follow each other, a part at offset 0 starts a new program image
+    if ((executeMode && paging) || (uint32_t)offset + size > MaxOverlaySize || (offset != 0 && offset > overlaySize))
+        return false;
+
+    // The changed image has to be loaded again before it can be paged
+    overlayMode = false;
+    paging = false;
+
+    if (offset == 0)
+        overlaySize = 0;
+
+    // Allocate the overlay buffer with the first part
+    if (overlay == nullptr)
+        overlay = new uint8_t[MaxOverlaySize]{0};
+
+    memcpy(overlay + offset, buffer, size);
+    overlaySize = std::max<uint16_t>(overlaySize, offset + size);
+
+    return true;
+}
+
+template <typename Model>
+boolean BasicCpuController<Model>::loadOverlayToRam(uint8_t size)
+{
+    if (!loadCodeMode || overlaySize == 0 || size == 0 || size > Model::MaxCodeSize)
+        return false;
+
+    segmentSize = size;
+    segment = 0;
+    previousSegment = 0;
+    paging = false;
+
+    pagedBytes = 0;
+    skippedBytes = 0;
+
+    // The first segment uses the normal load code path
+    loadCodeToRam(overlay, getSegmentLength(0));
+
+    overlayMode = true;
+
+    return true;
+}
+
+template <typename Model>
+void BasicCpuController<Model>::clearOverlay()
+{
+    overlayMode = false;
+    paging = false;
+
+    delete[] overlay;
+    overlay = nullptr;
+    overlaySize = 0;
+    segmentSize = 0;
+    segment = 0;
+}
+
+template <typename Model>
+boolean BasicCpuController<Model>::selectMicrocodeBank(uint8_t bank)
+{
+    if (bank >= Microcode::MaxBanks)
+        return false;
+
+    // Read the bank from flash, bank 0 is the built in microcode without any entries
+    typename Microcode::Entry *entries = new typename Microcode::Entry[Microcode::MaxBankEntries];
+    int size = 0;
+
+    if (bank != 0)
+    {
+        size = Microcode::loadBank(bank, entries, Microcode::MaxBankEntries);
+        if (size < 0)
+        {
+            delete[] entries;
+            return false;
+        }
     }
+
+    // Replace a bank which is still waiting to be applied
+    delete[] pendingBankEntries;
+
+    pendingBank = bank;
+    pendingBankSize = size;
+    pendingBankEntries = entries;
+
+    // Without a running program there is no instruction boundary to wait for
+    if (!executeMode || instructionStep == 0)
+        applyPendingBank();
+
+    return true;
 }
 
-void CpuController::loadCodeToRam(uint8_t buffer[], uint8_t size)
+template <typename Model>
+void BasicCpuController<Model>::applyPendingBank()
+{
+    UCode.applyBank(pendingBank, pendingBankEntries, pendingBankSize);
+
+    delete[] pendingBankEntries;
+
+    pendingBank = -1;
+    pendingBankSize = 0;
+    pendingBankEntries = nullptr;
+}
+
+template <typename Model>
+void BasicCpuController<Model>::loadCodeToRam(uint8_t buffer[], uint8_t size)
 {
     if (!loadCodeMode)
         return;
     
-    // Copy the buffer into the code array
-    if (size < 0xFF)
-    {
-        code = new uint8_t[size]{0};
-        codeSize = size;
+    // Copy the buffer into the code array, everything beyond the RAM of the board is cut off
+    codeSize = size < Model::MaxCodeSize ? size : Model::MaxCodeSize;
 
-        memcpy(code, buffer, size);
-    }
-    else
-    {
-        code = new uint8_t[0xFF]{0};
-        codeSize = 0xFF;
-        
-        memcpy(code, buffer, 0xFF);
-    }
+    delete[] code;
+    code = new uint8_t[codeSize]{0};
+
+    memcpy(code, buffer, codeSize);
+
+    // Plain code doesn't page in any overlay segments
+    overlayMode = false;
+    paging = false;
 
     // Reset the flags
     codeLoaded = 0; 
     codeToLoad = 0;
     addressSetup = false;
+    jumpToStart = true;
+    startShifted = false;
 }
 
-void CpuController::shiftInInstructionBuffer(uint8_t buffer[], uint8_t size)
+template <typename Model>
+void BasicCpuController<Model>::shiftInInstructionBuffer(uint8_t buffer[], uint8_t size)
 {
+    if (virtualCpu)
+    {
+        Emulator.read(buffer, size);
+        return;
+    }
+
     pinMode(DATA_PIN, INPUT);
     
     digitalWrite(IN_LATCH_PIN, LOW);
@@ -245,21 +600,99 @@ void CpuController::shiftInInstructionBuffer(uint8_t buffer[], uint8_t size)
     }
 }
 
-void CpuController::shiftOutControlBuffer(uint16_t controlWord, uint8_t busValue)
+template <typename Model>
+void BasicCpuController<Model>::shiftOutControlBuffer(ControlWord controlWord, uint8_t busValue)
 {
+    if (virtualCpu)
+    {
+        Emulator.latch(controlWord, busValue);
+        return;
+    }
+
     pinMode(DATA_PIN, OUTPUT);
     digitalWrite(OUT_LATCH_PIN, LOW);
 
     // Shift out the data for the bus
     shiftOut(DATA_PIN, CLOCK_PIN, MSBFIRST, busValue);
 
-    // Shift out the upper byte of the uint16_t
-    shiftOut(DATA_PIN, CLOCK_PIN, MSBFIRST, (controlWord ^ C_INV) >> 8);
-
-    // Shift out the lower byte of the uint16_t
-    shiftOut(DATA_PIN, CLOCK_PIN, MSBFIRST, (controlWord ^ C_INV) & 0xFF);
+    // Shift out the control word, the upper byte first
+    for (int8_t i = Model::ControlBytes - 1; i >= 0; i--)
+        shiftOut(DATA_PIN, CLOCK_PIN, MSBFIRST, (controlWord ^ C_INV) >> (i * 8));
 
     // Latch the data
     digitalWrite(OUT_LATCH_PIN, HIGH);
     pinMode(DATA_PIN, INPUT);
 }
+
+template <typename Model>
+void BasicCpuController<Model>::setVirtualCpu(boolean enabled)
+{
+    virtualCpu = enabled;
+    virtualPaused = false;
+
+    // Keep the recorded steps away from the other backend
+    reset();
+}
+
+template <typename Model>
+boolean BasicCpuController<Model>::stepVirtualCpu(uint32_t count)
+{
+    if (!virtualCpu || !executeMode)
+        return false;
+
+    for (uint32_t i = 0; i < count && !Emulator.isHalted(); i++)
+        clockVirtualCpu();
+
+    virtualPaused = true;
+
+    return true;
+}
+
+template <typename Model>
+boolean BasicCpuController<Model>::continueVirtualCpu(int16_t breakpoint)
+{
+    if (!virtualCpu || !executeMode)
+        return false;
+
+    // Runs with the main loop until the breakpoint is hit
+    Emulator.setBreakpoint(breakpoint);
+    virtualPaused = false;
+
+    return true;
+}
+
+template <typename Model>
+boolean BasicCpuController<Model>::reverseVirtualCpu(uint32_t count, int16_t breakpoint)
+{
+    // Paging changes RAM outside of the recorded steps
+    if (!virtualCpu || !executeMode || overlayMode)
+        return false;
+
+    uint32_t cycle = Emulator.getCycle();
+    uint32_t target = cycle - std::min(cycle - Emulator.getOldestCycle(), count);
+
+    if (!(breakpoint >= 0 ? Emulator.reverseContinue(breakpoint) : Emulator.rewind(target)))
+        return false;
+
+    // Continue with the restored instruction step, the cpu controller follows the emulated registers
+    instruction = Emulator.getRegister(REG_IR);
+    flags = Emulator.getRegister(REG_FLAGS);
+    instructionStep = Emulator.getRegister(REG_STEP);
+    controlWord = Emulator.getControlWord();
+    estimatedPc = Emulator.getRegister(REG_PC);
+    estimatedMar = Emulator.getRegister(REG_MAR);
+
+    virtualPaused = true;
+
+    return true;
+}
+
+#ifdef ARDUINO
+// Compile the cpu controller only for the board the firmware is built for, every revision adds its clock interrupt to IRAM
+template class BasicCpuController<DefaultCpuModel>;
+#else
+// Host builds compile the cpu controller for all board revisions
+template class BasicCpuController<CpuModelBreadboard>;
+template class BasicCpuController<CpuModelRev1>;
+template class BasicCpuController<CpuModelRev2>;
+#endif
@@ -3,13 +3,32 @@
 #include <PinDefinitions.h>
 
 #include <CpuMicrocode.h>
+#include <CpuProfiler.h>
+#include <CpuEmulator.h>
 
 #ifndef CPU_CONTROLLER_H
 #define CPU_CONTROLLER_H
 
+/* A single executed instruction step, as kept in the trace of the cpu controller. */
+template <typename Model>
+struct BasicCpuTraceEntry
+{
+    uint8_t instruction;
+    uint8_t flags;
+    uint8_t step;
+    typename Model::ControlWord controlWord;
+};
+
 /* Class which controls all cpu functions. */
-class CpuController
+template <typename Model>
+class BasicCpuController
 {
+public:
+
+    typedef typename Model::ControlWord ControlWord;
+    typedef BasicCpuMicrocode<Model> Microcode;
+    typedef BasicCpuTraceEntry<Model> TraceEntry;
+
 private:
 
     boolean executeMode = false;
@@ -21,14 +40,59 @@ private:
     uint8_t codeToLoad = 0;
 
     boolean addressSetup = false;
+    boolean jumpToStart = false;
+
+    /* The jump to the start is shifted out and gets taken by the cpu with the rising clock edge. */
+    boolean startShifted = false;
+
+    /* The program image which gets paged into RAM segment by segment in overlay mode. */
+    boolean overlayMode = false;
+    boolean paging = false;
 
-    uint16_t controlWord = 0x00;
+    uint8_t *overlay = nullptr;
+    uint16_t overlaySize = 0;
+    uint8_t segmentSize = 0;
+
+    uint16_t segment = 0;
+    uint16_t previousSegment = 0;
+    uint8_t segmentLoaded = 0;
+
+    /* RAM holds the whole previous segment, so bytes matching it don't have to be paged in. */
+    boolean previousInRam = true;
+
+    uint32_t pagedBytes = 0;
+    uint32_t skippedBytes = 0;
+
+    ControlWord controlWord = 0x00;
 
     uint8_t flags = 0x00;
 
     uint8_t instruction = 0x00;
     uint8_t instructionStep = 0x00;
 
+    /* The number of executed instruction steps since boot. */
+    uint32_t cycleCount = 0;
+
+    /* The most recently executed instruction steps, the oldest one is at the trace index. */
+    TraceEntry trace[0x20]{};
+    uint8_t traceIndex = 0;
+
+    /* Drives the emulator instead of the shift registers, it gets clocked by the main loop. */
+    boolean virtualCpu = false;
+    boolean virtualPaused = false;
+
+    /* Gets cleared when the serial port is used for something else than the debug statements. */
+    boolean debugOutput = true;
+
+    /* The program counter and memory address register of the cpu, estimated from the control words and the code in RAM. */
+    uint8_t estimatedPc = 0x00;
+    uint8_t estimatedMar = 0x00;
+
+    /* The microcode bank which gets applied at the next instruction boundary or -1 if none. */
+    int8_t pendingBank = -1;
+    uint8_t pendingBankSize = 0;
+    typename Microcode::Entry *pendingBankEntries = nullptr;
+
     /* Gets set when a falling edge of the cpu clock was detected. */
     static volatile boolean clockFalling;
 
@@ -44,23 +108,57 @@ private:
     /* This will initialize a pin interupt which will trigger on the raising edge of the cpu clock. */
     void initClockInterrupt();
 
+    /* This handles a falling edge of the cpu clock in the current mode. */
+    void handleClockFalling();
+
+    /* This handles a rising edge of the cpu clock in the current mode. */
+    void handleClockRising();
+
+    /* This runs a full clock cycle of the virtual cpu. */
+    void clockVirtualCpu();
+
     /* This will try to execute the current instruction on a rising clock pulse. */
     void executeInstruction();
 
     /* This will try to load the given code into RAM everytime a rising clock pulse is detected. */
     void executeLoadCode();
 
+    /* This will page the next overlay segment into RAM everytime a clock pulse is detected and resume execution afterwards.
+     * Bytes matching the previous segment are skipped, so programs have to keep their data above the segment area. */
+    void executePageSegment();
+
+    /* This will start paging the next overlay segment into RAM if there is one left. */
+    boolean beginPaging();
+
+    /* Returns the number of bytes of the given overlay segment. */
+    uint8_t getSegmentLength(uint16_t index);
+
+    /* Returns the code at the given RAM address, as it was last loaded by the cpu controller. */
+    uint8_t getLoadedCode(uint8_t address);
+
+    /* This will write the given value to the given RAM address, returns true once the value was written. */
+    boolean shiftOutCodeByte(uint8_t address, uint8_t value);
+
+    /* This will apply the pending microcode bank and release its entries. */
+    void applyPendingBank();
+
     /* This will shift in the inputs of the 74HC165 shift registers and stores them in the given buffer. */
     void shiftInInstructionBuffer(uint8_t buffer[], uint8_t size);
 
     /* This will shift out the control word and bus value to three 74HC595 shift registers. */
-    void shiftOutControlBuffer(uint16_t controlWord, uint8_t busValue);
+    void shiftOutControlBuffer(ControlWord controlWord, uint8_t busValue);
 
 public:
     /* The microcode the cpu uses. */
-    CpuMicrocode UCode;
+    Microcode UCode;
+
+    /* Counts where the executed programs spend their clock cycles. */
+    CpuProfiler Profile;
+
+    /* The cpu which gets driven instead of the hardware when the virtual cpu is enabled. */
+    BasicCpuEmulator<Model> Emulator;
 
-    CpuController()
+    BasicCpuController()
     {
         // Init the code array
         code = new uint8_t[0];
@@ -100,13 +198,97 @@ public:
     uint8_t getInstructionStep() { return instructionStep; }
 
     /* Returns the current control word. */
-    uint16_t getControlWord() { return controlWord; }
+    ControlWord getControlWord() { return controlWord; }
+
+    /* Returns the estimated program counter of the cpu. */
+    uint8_t getEstimatedPc() { return estimatedPc; }
 
     /* Returns the amount of code to load. */
     uint8_t getCodeToLoad() { return codeSize; }
 
     /* Returns the amount of code loaded. */
     uint8_t getCodeLoaded() { return codeLoaded; }
+
+    /* Returns if all code is loaded into RAM and the program counter points to its start. */
+    boolean isCodeLoaded() { return codeLoaded >= codeSize && !jumpToStart; }
+
+    /* Returns the number of executed instruction steps since boot. */
+    uint32_t getCycleCount() { return cycleCount; }
+
+    /* The number of instruction steps kept in the trace. */
+    static const uint8_t MaxTraceEntries = 0x20;
+
+    /* Returns the executed instruction step at the given index, zero is the oldest one in the trace. */
+    const TraceEntry &getTraceEntry(uint8_t index) { return trace[(traceIndex + index) % MaxTraceEntries]; }
+
+    /* Enables or disables the debug statements on the serial port. */
+    void setDebugOutput(boolean enabled) { debugOutput = enabled; }
+
+    /* Returns if the debug statements are printed on the serial port. */
+    boolean getDebugOutput() { return debugOutput; }
+
+    /* The maximum size of a program image in overlay mode. */
+    static const uint16_t MaxOverlaySize = 0x1000;
+
+    /* Copies a part of a program image which is larger than the cpu RAM into the overlay buffer. */
+    boolean writeOverlay(uint16_t offset, uint8_t buffer[], uint8_t size);
+
+    /* Starts overlay mode and loads the first segment of the overlay buffer into RAM. */
+    boolean loadOverlayToRam(uint8_t size);
+
+    /* Stops overlay mode and releases the overlay buffer. */
+    void clearOverlay();
+
+    /* Returns if the cpu controller is in overlay mode. */
+    boolean getOverlayMode() { return overlayMode; }
+
+    /* Returns if the cpu controller is currently paging a segment into RAM. */
+    boolean getPaging() { return paging; }
+
+    /* Returns the size of the program image in the overlay buffer. */
+    uint16_t getOverlaySize() { return overlaySize; }
+
+    /* Returns the size of a single overlay segment. */
+    uint8_t getSegmentSize() { return segmentSize; }
+
+    /* Returns the overlay segment which is currently in RAM. */
+    uint16_t getSegment() { return segment; }
+
+    /* Returns the number of bytes written to RAM while paging. */
+    uint32_t getPagedBytes() { return pagedBytes; }
+
+    /* Returns the number of bytes which didn't need to be written while paging, because they were already in RAM. */
+    uint32_t getSkippedBytes() { return skippedBytes; }
+
+    /* Drives the emulator instead of the hardware, this resets the cpu controller. */
+    void setVirtualCpu(boolean enabled);
+
+    /* Returns if the emulator is driven instead of the hardware. */
+    boolean getVirtualCpu() { return virtualCpu; }
+
+    /* Stops or resumes clocking the virtual cpu with the main loop. */
+    void setVirtualPaused(boolean paused) { virtualPaused = paused; }
+
+    /* Returns if the virtual cpu is paused. */
+    boolean getVirtualPaused() { return virtualPaused; }
+
+    /* Executes the given number of clock cycles on the virtual cpu and pauses it afterwards. */
+    boolean stepVirtualCpu(uint32_t count);
+
+    /* Resumes the virtual cpu until it fetches from the given address, -1 runs without a breakpoint. */
+    boolean continueVirtualCpu(int16_t breakpoint);
+
+    /* Steps the virtual cpu back by the given number of clock cycles or to the last fetch from the breakpoint if it isn't -1. */
+    boolean reverseVirtualCpu(uint32_t count, int16_t breakpoint);
+
+    /* Switches to the given microcode bank at the next instruction boundary. */
+    boolean selectMicrocodeBank(uint8_t bank);
+
+    /* Returns the microcode bank which waits to be applied or -1 if none. */
+    int8_t getPendingBank() { return pendingBank; }
 };
 
+typedef BasicCpuTraceEntry<DefaultCpuModel> CpuTraceEntry;
+typedef BasicCpuController<DefaultCpuModel> CpuController;
+
 #endif
\ No newline at end of file
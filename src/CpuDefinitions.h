@@ -44,11 +44,14 @@
 #define FLAGS_Z0C1 0b10
 #define FLAGS_Z1C1 0b11
 
+#define FLAGS_N 0b100 // Negative flag, only on boards with three flag bits
+
 // ##############################################
 // Here are all different instructions defined.
 // ##############################################
 #define NOP 0x00
 #define HLT 0x01
+#define PAG 0x02 // Page in the next overlay segment
 #define JMP 0x04
 #define JMC 0x05
 #define JMZ 0x06
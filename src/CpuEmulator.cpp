@@ -0,0 +1,302 @@
+#include "CpuEmulator.h"
+
+// The largest delta of a single clock cycle: mask, all registers and a RAM write
+static const uint8_t MAX_DELTA_SIZE = 2 + REG_COUNT + 2;
+
+template <typename Model>
+void BasicCpuEmulator<Model>::execute(State &state, ControlWord controlWord, uint8_t busValue, uint8_t step)
+{
+    uint8_t *registers = state.registers;
+
+    // The ALU always outputs the sum of A and B, a subtraction adds the two's complement of B
+    uint16_t sum = controlWord & C_SU ? registers[REG_A] + (uint8_t)~registers[REG_B] + 1 : registers[REG_A] + registers[REG_B];
+
+
+    // The upper three bits select the register which drives the bus
+    uint8_t bus = 0x00;
+
+    switch (controlWord & C_EPO)
+    {
+    case C_CO: bus = registers[REG_PC]; break;
+    case C_AO: bus = registers[REG_A]; break;
+    case C_BO: bus = registers[REG_B]; break;
+    case C_EO: bus = sum; break;
+    case C_RO: bus = state.ram[registers[REG_MAR]]; break;
+    case C_IOO: bus = registers[REG_IOP]; break;
+    case C_EPO: bus = busValue; break;
+    }
+
+    // All registers take the bus value with the same clock edge, so RAM is written to the old address
+    if (controlWord & C_RI) state.ram[registers[REG_MAR]] = bus;
+
+    if (controlWord & C_AI) registers[REG_A] = bus;
+    if (controlWord & C_BI) registers[REG_B] = bus;
+    if (controlWord & C_OI) registers[REG_OUT] = bus;
+    // Addresses wrap around at the end of RAM, this is a no-op with 256 bytes
+    if (controlWord & C_MI) registers[REG_MAR] = bus & Model::AddressMask;
+    if (controlWord & C_IOI) registers[REG_IOP] = bus;
+
+    if (controlWord & C_FI)
+    {
+        registers[REG_FLAGS] = ((sum & 0xFF) == 0 ? FLAGS_Z1C0 : 0) | (sum > 0xFF ? FLAGS_Z0C1 : 0);
+
+        if (Model::FlagBits > 2 && (sum & 0x80))
+            registers[REG_FLAGS] |= FLAGS_N;
+    }
+
+    if (controlWord & C_IRI) registers[REG_IR] = bus;
+
+    // Loading the program counter wins over counting
+    if (controlWord & C_JMP)
+        registers[REG_PC] = bus & Model::AddressMask;
+    else if (controlWord & C_CE)
+        registers[REG_PC] = (registers[REG_PC] + 1) & Model::AddressMask;
+
+    registers[REG_STEP] = step;
+
+    for (uint8_t i = 0; i < Model::ControlBytes; i++)
+        registers[REG_CW_0 + i] = controlWord >> (i * 8);
+
+    state.cycle++;
+}
+
+template <typename Model>
+void BasicCpuEmulator<Model>::clock(uint8_t step)
+{
+    uint8_t previous[REG_COUNT];
+    memcpy(previous, state.registers, sizeof(previous));
+
+    execute(state, latchedWord, latchedBus, step);
+
+    // The instruction was fetched from the address in the MAR
+    if ((latchedWord & C_IRI) && breakpoint == previous[REG_MAR])
+        breakpointHit = true;
+
+    if (snapshots == nullptr)
+        return;
+
+    recordDelta(previous);
+
+    if (state.cycle % SnapshotInterval == 0)
+        takeSnapshot();
+}
+
+template <typename Model>
+void BasicCpuEmulator<Model>::recordDelta(const uint8_t previous[])
+{
+    // Make room by dropping the oldest snapshot with all of its deltas
+    while (snapshotCount > 1 && deltaEnd - deltaStart + MAX_DELTA_SIZE > DeltaSize)
+        dropOldestSnapshot();
+
+    // A single snapshot interval never fills the ring, but start over instead of overwriting the deltas in use
+    if (deltaEnd - deltaStart + MAX_DELTA_SIZE > DeltaSize)
+    {
+        clearHistory();
+        return;
+    }
+
+    // Write the changed registers behind the mask, which is filled in afterwards
+    uint32_t start = deltaEnd;
+    uint16_t changes = 0;
+
+    deltaEnd += 2;
+
+    for (uint8_t i = 0; i < REG_COUNT; i++)
+    {
+        if (previous[i] != state.registers[i])
+        {
+            changes |= 1 << i;
+            deltas[deltaEnd++ % DeltaSize] = state.registers[i];
+        }
+    }
+
+    // The executed control word tells if RAM was written
+    if (getSignals(state.registers) & C_RI)
+    {
+        deltas[deltaEnd++ % DeltaSize] = previous[REG_MAR];
+        deltas[deltaEnd++ % DeltaSize] = state.ram[previous[REG_MAR]];
+    }
+
+    deltas[start % DeltaSize] = changes >> 8;
+    deltas[(start + 1) % DeltaSize] = changes & 0xFF;
+}
+
+template <typename Model>
+boolean BasicCpuEmulator<Model>::applyDelta(uint8_t registers[], uint8_t ram[], uint32_t &position)
+{
+    uint16_t mask = deltas[position++ % DeltaSize] << 8;
+    mask |= deltas[position++ % DeltaSize];
+
+    for (uint8_t i = 0; i < REG_COUNT; i++)
+    {
+        if (mask & (1 << i))
+            registers[i] = deltas[position++ % DeltaSize];
+    }
+
+    uint16_t signals = getSignals(registers);
+
+    if (signals & C_RI)
+    {
+        uint8_t address = deltas[position++ % DeltaSize];
+        uint8_t value = deltas[position++ % DeltaSize];
+
+        // Searching only follows the registers
+        if (ram != nullptr)
+            ram[address] = value;
+    }
+
+    return signals & C_IRI;
+}
+
+template <typename Model>
+void BasicCpuEmulator<Model>::takeSnapshot()
+{
+    if (snapshotCount == MaxSnapshots)
+        dropOldestSnapshot();
+
+    Snapshot &snapshot = getSnapshot(snapshotCount);
+    snapshot.state = state;
+    snapshot.deltaStart = deltaEnd;
+
+    snapshotCount++;
+}
+
+template <typename Model>
+void BasicCpuEmulator<Model>::dropOldestSnapshot()
+{
+    snapshotStart = (snapshotStart + 1) % MaxSnapshots;
+    snapshotCount--;
+
+    deltaStart = snapshotCount > 0 ? getSnapshot(0).deltaStart : deltaEnd;
+}
+
+template <typename Model>
+void BasicCpuEmulator<Model>::setHistory(boolean enabled)
+{
+    if (enabled == getHistory())
+        return;
+
+    if (enabled)
+    {
+        snapshots = new Snapshot[MaxSnapshots];
+        deltas = new uint8_t[DeltaSize];
+
+        clearHistory();
+        return;
+    }
+
+    delete[] snapshots;
+    delete[] deltas;
+
+    snapshots = nullptr;
+    deltas = nullptr;
+    snapshotCount = 0;
+}
+
+template <typename Model>
+void BasicCpuEmulator<Model>::clearHistory()
+{
+    if (snapshots == nullptr)
+        return;
+
+    snapshotStart = 0;
+    snapshotCount = 0;
+    deltaStart = 0;
+    deltaEnd = 0;
+
+    takeSnapshot();
+}
+
+template <typename Model>
+boolean BasicCpuEmulator<Model>::rewind(uint32_t cycle)
+{
+    if (snapshots == nullptr || cycle > state.cycle || cycle < getOldestCycle())
+        return false;
+
+    // Start at the last snapshot before the cycle and replay the deltas up to it
+    uint8_t index = snapshotCount - 1;
+    while (getSnapshot(index).state.cycle > cycle)
+        index--;
+
+    Snapshot &snapshot = getSnapshot(index);
+    uint32_t position = snapshot.deltaStart;
+
+    state = snapshot.state;
+
+    while (state.cycle < cycle)
+    {
+        applyDelta(state.registers, state.ram, position);
+        state.cycle++;
+    }
+
+    // Executing again records a new future
+    deltaEnd = position;
+    snapshotCount = index + 1;
+
+    // The restored control word is at the outputs again, so a halt keeps the clock stopped
+    latch(getControlWord(), 0x00);
+    breakpointHit = false;
+
+    return true;
+}
+
+template <typename Model>
+uint32_t BasicCpuEmulator<Model>::findFetch(uint8_t index, uint32_t endCycle, uint8_t address)
+{
+    Snapshot &snapshot = getSnapshot(index);
+
+    uint8_t registers[REG_COUNT];
+    memcpy(registers, snapshot.state.registers, sizeof(registers));
+
+    uint32_t cycle = snapshot.state.cycle;
+    uint32_t position = snapshot.deltaStart;
+    uint32_t found = 0;
+
+    while (cycle < endCycle)
+    {
+        uint8_t mar = registers[REG_MAR];
+
+        if (applyDelta(registers, nullptr, position) && mar == address)
+            found = cycle + 1;
+
+        cycle++;
+    }
+
+    return found;
+}
+
+template <typename Model>
+boolean BasicCpuEmulator<Model>::reverseContinue(uint8_t address)
+{
+    if (snapshots == nullptr || state.cycle == 0)
+        return false;
+
+    // Search the snapshot intervals from the newest to the oldest, the current cycle itself doesn't count
+    uint32_t endCycle = state.cycle - 1;
+
+    for (int16_t index = snapshotCount - 1; index >= 0; index--)
+    {
+        uint32_t snapshotCycle = getSnapshot(index).state.cycle;
+
+        if (snapshotCycle < endCycle)
+        {
+            uint32_t found = findFetch(index, endCycle, address);
+            if (found > 0)
+                return rewind(found);
+        }
+
+        endCycle = std::min(endCycle, snapshotCycle);
+    }
+
+    return false;
+}
+
+#ifdef ARDUINO
+// Compile the emulator for the board the firmware is built for
+template class BasicCpuEmulator<DefaultCpuModel>;
+#else
+// Host builds compile the emulator for all board revisions
+template class BasicCpuEmulator<CpuModelBreadboard>;
+template class BasicCpuEmulator<CpuModelRev1>;
+template class BasicCpuEmulator<CpuModelRev2>;
+#endif
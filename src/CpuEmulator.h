@@ -0,0 +1,209 @@
+#include <Arduino.h>
+
+#include <CpuDefinitions.h>
+#include <CpuModel.h>
+
+#ifndef CPU_EMULATOR_H
+#define CPU_EMULATOR_H
+
+/* Indices of all registers of the emulated cpu. */
+enum CpuRegister
+{
+    REG_A,
+    REG_B,
+    REG_PC,
+    REG_MAR,
+    REG_IR,
+    REG_IOP,
+    REG_OUT,
+    REG_FLAGS,
+    REG_STEP,       // The instruction step of the cpu controller after the clock cycle
+    REG_CW_0,       // The executed control word, least significant byte first
+    REG_CW_1,
+    REG_CW_2,
+    REG_CW_3,
+    REG_COUNT
+};
+
+/* The complete state of the emulated cpu after the given number of clock cycles. */
+template <typename Model>
+struct BasicCpuEmulatorState
+{
+    uint8_t registers[REG_COUNT];
+    uint8_t ram[Model::RamSize];
+    uint32_t cycle;
+};
+
+/* A full copy of the state, the deltas of all following clock cycles start at the given position. */
+template <typename Model>
+struct BasicCpuEmulatorSnapshot
+{
+    BasicCpuEmulatorState<Model> state;
+    uint32_t deltaStart;
+};
+
+/* Class which emulates the cpu behind the shift registers, so programs can run and be debugged without the hardware.
+ * It keeps a history of periodic snapshots plus the changes of every clock cycle, to step back in time. */
+template <typename Model>
+class BasicCpuEmulator
+{
+public:
+
+    typedef typename Model::ControlWord ControlWord;
+    typedef BasicCpuEmulatorState<Model> State;
+    typedef BasicCpuEmulatorSnapshot<Model> Snapshot;
+
+private:
+
+    State state{};
+
+    /* The control word and bus value at the outputs of the shift registers. */
+    ControlWord latchedWord = 0x00;
+    uint8_t latchedBus = 0x00;
+
+    /* Fetches from this address stop the emulator, -1 if none. */
+    int16_t breakpoint = -1;
+    boolean breakpointHit = false;
+
+    /* Ring of the most recent snapshots, the oldest one is the start of the history. */
+    Snapshot *snapshots = nullptr;
+    uint8_t snapshotStart = 0;
+    uint8_t snapshotCount = 0;
+
+    /* Ring of the encoded changes of each clock cycle, the positions count up and wrap inside the ring. */
+    uint8_t *deltas = nullptr;
+    uint32_t deltaStart = 0;
+    uint32_t deltaEnd = 0;
+
+    /* This executes the given control word on the given state. */
+    static void execute(State &state, ControlWord controlWord, uint8_t busValue, uint8_t step);
+
+    /* This appends the changes of the last clock cycle to the delta ring, the registers get compared with the previous ones. */
+    void recordDelta(const uint8_t previous[]);
+
+    /* Returns the signals of the executed control word in the given registers, they tell about fetches and RAM writes. */
+    static uint16_t getSignals(const uint8_t registers[]) { return registers[REG_CW_1] << 8 | registers[REG_CW_0]; }
+
+    /* This applies the delta at the given position to the registers and RAM and moves the position behind it, returns true if it was a fetch.
+     * Without RAM only the registers get followed. */
+    boolean applyDelta(uint8_t registers[], uint8_t ram[], uint32_t &position);
+
+    /* This appends a snapshot of the current state and drops the oldest one when the ring is full. */
+    void takeSnapshot();
+
+    /* This drops the oldest snapshot and all deltas up to the next one. */
+    void dropOldestSnapshot();
+
+    /* Returns the snapshot at the given index, zero is the oldest one. */
+    Snapshot &getSnapshot(uint8_t index) { return snapshots[(snapshotStart + index) % MaxSnapshots]; }
+
+    /* This replays the deltas of the given snapshot up to the given cycle and returns the last cycle a fetch from the address happened or 0. */
+    uint32_t findFetch(uint8_t index, uint32_t endCycle, uint8_t address);
+
+public:
+
+    /* The number of snapshots kept in the history. */
+    static const uint8_t MaxSnapshots = 0x08;
+
+    /* The number of clock cycles between two snapshots. */
+    static const uint16_t SnapshotInterval = 0x80;
+
+    /* The size of the delta ring in bytes. */
+    static const uint16_t DeltaSize = 0x1000;
+
+    ~BasicCpuEmulator() { setHistory(false); }
+
+    /* This sets the outputs of the shift registers, they get executed with the next clock cycle. */
+    void latch(ControlWord controlWord, uint8_t busValue)
+    {
+        latchedWord = controlWord;
+        latchedBus = busValue;
+    }
+
+    /* This returns the inputs of the shift registers, the instruction and the flags register. */
+    void read(uint8_t buffer[], uint8_t size)
+    {
+        if (size > 0) buffer[0] = state.registers[REG_IR];
+        if (size > 1) buffer[1] = state.registers[REG_FLAGS];
+    }
+
+    /* This executes the latched control word and records it in the history, the step is the one of the cpu controller afterwards. */
+    void clock(uint8_t step);
+
+    /* Returns if the halt signal stops the clock. */
+    boolean isHalted() { return latchedWord & C_HLT; }
+
+    /* Returns the state of the emulated cpu. */
+    const State &getState() { return state; }
+
+    /* This replaces the state of the emulated cpu, e.g. to run code from given registers, and starts a new history with it. */
+    void setState(const State &newState)
+    {
+        state = newState;
+        clearHistory();
+    }
+
+    /* Returns a single register of the emulated cpu. */
+    uint8_t getRegister(CpuRegister reg) { return state.registers[reg]; }
+
+    /* Returns the executed control word of the last clock cycle. */
+    ControlWord getControlWord()
+    {
+        ControlWord controlWord = 0;
+        for (uint8_t i = 0; i < Model::ControlBytes; i++)
+            controlWord |= (ControlWord)state.registers[REG_CW_0 + i] << (i * 8);
+
+        return controlWord;
+    }
+
+    /* Returns the number of executed clock cycles. */
+    uint32_t getCycle() { return state.cycle; }
+
+    /* Stops the emulator with the next fetch from the given address, -1 removes the breakpoint. */
+    void setBreakpoint(int16_t address)
+    {
+        breakpoint = address;
+        breakpointHit = false;
+    }
+
+    /* Returns the address of the breakpoint or -1 if none. */
+    int16_t getBreakpoint() { return breakpoint; }
+
+    /* Returns and clears if the last clock cycle fetched from the breakpoint address. */
+    boolean takeBreakpointHit()
+    {
+        boolean hit = breakpointHit;
+        breakpointHit = false;
+
+        return hit;
+    }
+
+    /* Enables or disables recording the history, it starts with a snapshot of the current state. */
+    void setHistory(boolean enabled);
+
+    /* Returns if the history is recorded. */
+    boolean getHistory() { return snapshots != nullptr; }
+
+    /* This drops the recorded history and starts a new one with the current state. */
+    void clearHistory();
+
+    /* Returns the oldest clock cycle the emulator can go back to. */
+    uint32_t getOldestCycle() { return snapshotCount > 0 ? getSnapshot(0).state.cycle : state.cycle; }
+
+    /* Returns the number of snapshots in the history. */
+    uint8_t getSnapshotCount() { return snapshotCount; }
+
+    /* Returns the number of bytes used by the deltas in the history. */
+    uint32_t getDeltaBytes() { return deltaEnd - deltaStart; }
+
+    /* This restores the state after the given clock cycle and drops the history after it, returns false if it is too old. */
+    boolean rewind(uint32_t cycle);
+
+    /* This goes back to the last fetch from the given address before the current clock cycle, returns false if there is none in the history. */
+    boolean reverseContinue(uint8_t address);
+};
+
+typedef BasicCpuEmulatorState<DefaultCpuModel> CpuEmulatorState;
+typedef BasicCpuEmulator<DefaultCpuModel> CpuEmulator;
+
+#endif
@@ -0,0 +1,188 @@
+#include "CpuJobQueue.h"
+
+void CpuJobQueue::handle()
+{
+    // Start the next job, as soon as the last one is finished
+    if (current < 0)
+    {
+        int8_t slot = findNextJob();
+        if (slot >= 0)
+            startJob(slot);
+
+        return;
+    }
+
+    CpuJob &job = jobs[current];
+
+    // Somebody else switched the mode of the cpu controller
+    if ((job.state == JOB_LOADING && !cpu.getLoadCodeMode()) || (job.state == JOB_EXECUTING && !cpu.getExecuteMode()))
+    {
+        finishJob(JOB_ABORTED);
+        return;
+    }
+
+    if ((micros() - stateStart) / 1000 > job.timeout)
+    {
+        finishJob(JOB_TIMEOUT);
+        return;
+    }
+
+    if (job.state == JOB_LOADING)
+    {
+        if (!cpu.isCodeLoaded())
+            return;
+
+        // Switch straight from loading to executing
+        job.loadTime = micros() - stateStart;
+
+        cpu.setLoadCodeMode(false);
+        cpu.setExecuteMode(true);
+
+        job.state = JOB_EXECUTING;
+        stateStart = micros();
+        cycleStart = cpu.getCycleCount();
+
+        return;
+    }
+
+    // The program is done when the halt signal shows up in the control word
+    if (cpu.getControlWord() & C_HLT)
+        finishJob(JOB_HALTED);
+    else if (cpu.getCycleCount() - cycleStart >= job.cycleBudget)
+        finishJob(JOB_BUDGET_EXCEEDED);
+}
+
+int8_t CpuJobQueue::findNextJob()
+{
+    int8_t next = -1;
+
+    for (uint8_t i = 0; i < MaxJobs; i++)
+    {
+        if (jobs[i].state == JOB_QUEUED && (next < 0 || jobs[i].id < jobs[next].id))
+            next = i;
+    }
+
+    return next;
+}
+
+void CpuJobQueue::startJob(int8_t slot)
+{
+    CpuJob &job = jobs[slot];
+
+    // Leave any other mode, so the cpu controller can switch to load code mode
+    cpu.setExecuteMode(false);
+    cpu.setLoadCodeMode(false);
+
+    cpu.setLoadCodeMode(true);
+    cpu.loadCodeToRam(job.code, job.codeSize);
+
+    current = slot;
+    job.state = JOB_LOADING;
+    stateStart = micros();
+}
+
+void CpuJobQueue::finishJob(CpuJobState state)
+{
+    CpuJob &job = jobs[current];
+
+    if (job.state == JOB_EXECUTING)
+    {
+        job.cycles = cpu.getCycleCount() - cycleStart;
+        job.executeTime = micros() - stateStart;
+    }
+
+    job.flags = cpu.getFlags();
+    job.pc = cpu.getEstimatedPc();
+    job.state = state;
+
+    // Stop the cpu, this also clears the halt signal for the next job
+    cpu.setExecuteMode(false);
+    cpu.setLoadCodeMode(false);
+
+    current = -1;
+
+    // Debug statement
+    if (cpu.getDebugOutput())
+    {
+        Serial.print("Job finished!\n\tid: ");
+        Serial.print(job.id);
+        Serial.print("; state: ");
+        Serial.print(getStateName(state));
+        Serial.print("; cycles: ");
+        Serial.print(job.cycles);
+        Serial.println();
+    }
+}
+
+uint16_t CpuJobQueue::add(uint8_t code[], uint8_t size, uint32_t cycleBudget, uint32_t timeout)
+{
+    // Use a free slot or replace the oldest finished job
+    int8_t slot = -1;
+
+    for (uint8_t i = 0; i < MaxJobs; i++)
+    {
+        CpuJobState state = jobs[i].state;
+
+        if (state == JOB_FREE)
+        {
+            slot = i;
+            break;
+        }
+
+        if (state >= JOB_HALTED && (slot < 0 || jobs[i].id < jobs[slot].id))
+            slot = i;
+    }
+
+    if (slot < 0)
+        return 0;
+
+    CpuJob &job = jobs[slot];
+
+    memset(&job, 0, sizeof(job));
+    memcpy(job.code, code, size);
+
+    job.id = nextId++;
+    job.state = JOB_QUEUED;
+    job.codeSize = size;
+    job.cycleBudget = cycleBudget;
+    job.timeout = timeout;
+
+    return job.id;
+}
+
+uint8_t CpuJobQueue::getFreeSlots()
+{
+    uint8_t free = 0;
+
+    for (uint8_t i = 0; i < MaxJobs; i++)
+    {
+        if (jobs[i].state == JOB_FREE || jobs[i].state >= JOB_HALTED)
+            free++;
+    }
+
+    return free;
+}
+
+void CpuJobQueue::clear()
+{
+    if (current >= 0)
+        finishJob(JOB_ABORTED);
+
+    for (uint8_t i = 0; i < MaxJobs; i++)
+        jobs[i].state = JOB_FREE;
+}
+
+const __FlashStringHelper *CpuJobQueue::getStateName(CpuJobState state)
+{
+    switch (state)
+    {
+    case JOB_QUEUED: return F("queued");
+    case JOB_LOADING: return F("loading");
+    case JOB_EXECUTING: return F("executing");
+    case JOB_HALTED: return F("halted");
+    case JOB_BUDGET_EXCEEDED: return F("budgetExceeded");
+    case JOB_TIMEOUT: return F("timeout");
+    case JOB_ABORTED: return F("aborted");
+    default: return F("free");
+    }
+}
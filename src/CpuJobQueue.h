@@ -0,0 +1,104 @@
+#include <Arduino.h>
+
+#include <CpuController.h>
+
+#ifndef CPU_JOB_QUEUE_H
+#define CPU_JOB_QUEUE_H
+
+/* All states a job passes through. */
+enum CpuJobState
+{
+    JOB_FREE,
+    JOB_QUEUED,
+    JOB_LOADING,
+    JOB_EXECUTING,
+    JOB_HALTED,
+    JOB_BUDGET_EXCEEDED,
+    JOB_TIMEOUT,
+    JOB_ABORTED
+};
+
+/* Holds a program which gets loaded and executed by the job queue, together with its results. */
+struct CpuJob
+{
+    uint16_t id;
+    CpuJobState state;
+
+    uint8_t code[0xFF];
+    uint8_t codeSize;
+
+    /* The maximum number of clock cycles and milliseconds the program may run. */
+    uint32_t cycleBudget;
+    uint32_t timeout;
+
+    /* Results of the job, the times are in microseconds. */
+    uint32_t cycles;
+    uint32_t loadTime;
+    uint32_t executeTime;
+    uint8_t flags;
+    uint8_t pc;
+};
+
+/* Class which runs queued programs one after another: load, execute, wait for a halt and continue with the next one. */
+class CpuJobQueue
+{
+private:
+
+    CpuController &cpu;
+
+    CpuJob jobs[0x08];
+
+    uint16_t nextId = 1;
+    int8_t current = -1;
+
+    uint32_t stateStart = 0;
+    uint32_t cycleStart = 0;
+
+    /* Returns the slot of the queued job with the lowest id or -1 if none. */
+    int8_t findNextJob();
+
+    /* Starts loading the job in the given slot. */
+    void startJob(int8_t slot);
+
+    /* Stores the results of the current job and stops the cpu. */
+    void finishJob(CpuJobState state);
+
+public:
+
+    /* The maximum number of queued and finished jobs. */
+    static const uint8_t MaxJobs = 0x08;
+
+    /* The clock cycles a job may run, if no budget is given. */
+    static const uint32_t DefaultCycleBudget = 100000;
+
+    /* The milliseconds a job may take, if no timeout is given. */
+    static const uint32_t DefaultTimeout = 60000;
+
+    CpuJobQueue(CpuController &controller) : cpu(controller)
+    {
+        clear();
+    }
+
+    /* This drives the current job and starts the next one, it has to be called from the main loop. */
+    void handle();
+
+    /* This queues a program and returns its job id or 0 if the queue is full. */
+    uint16_t add(uint8_t code[], uint8_t size, uint32_t cycleBudget, uint32_t timeout);
+
+    /* This aborts the current job and removes all jobs. */
+    void clear();
+
+    /* Returns the number of jobs which can be added, finished jobs get replaced by new ones. */
+    uint8_t getFreeSlots();
+
+    /* Returns if a job is loading or executing, the cpu controller mustn't be used otherwise then. */
+    boolean isBusy() { return current >= 0; }
+
+    /* Returns the job in the given slot. */
+    const CpuJob &getJob(uint8_t slot) { return jobs[slot]; }
+
+    /* Returns the name of the given job state. */
+    static const __FlashStringHelper *getStateName(CpuJobState state);
+};
+
+#endif
@@ -1,76 +1,220 @@
+#include <LittleFS.h>
+
 #include "CpuMicrocode.h"
 
-void CpuMicrocode::init()
+// Header of a microcode bank file: 'U', 'C', version, steps, flag bits and control bytes of the board, entry count
+static const uint8_t BANK_MAGIC[] = {'U', 'C', 0x02};
+
+template <typename Model>
+void BasicCpuMicrocode<Model>::init()
 {
-    /* Initialize all different instructions and their microcodes */
-    auto nop = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, 0, 0, 0, 0, 0});     // NOP
-    auto hlt = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_HLT, 0, 0, 0, 0}); // HLT
+    if constexpr (TablesOnHeap)
+    {
+        if (!UCODE)
+            UCODE.reset(new Table[Model::FlagStates]);
+    }
 
-    auto jmp = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_JMP | C_CE, 0, 0, 0});  // JMP
-    auto jmc = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_CE, 0, 0, 0});                 // JMC
-    auto jmz = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_CE, 0, 0, 0});                 // JMZ
-    auto jnz = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_JMP | C_CE, 0, 0, 0});  // JNZ
+    /* Clear all microcode, so no custom instruction of a previous bank is left */
+    for (uint8_t flags = 0; flags < Model::FlagStates; flags++)
+        memset(UCODE[flags], 0, sizeof(Table));
+    memset(STEPS, MaxInstructionStep + 1, sizeof(STEPS));
 
-    auto lda = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_MI | C_CE, C_RO | C_AI, 0, 0}); // LDA
-    auto ldb = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_MI | C_CE, C_RO | C_BI, 0, 0}); // LDB
-    auto sta = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_MI | C_CE, C_AO | C_RI, 0, 0}); // STA
-    auto stb = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_MI | C_CE, C_BO | C_RI, 0, 0}); // STB
-    auto ste = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_MI | C_CE, C_EO | C_RI, 0, 0}); // STE
+    activeBank = 0;
+    bankOpcodeCount = 0;
 
-    auto add = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_EO | C_AI | C_FI, 0, 0, 0, 0});        // ADD
-    auto sub = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_EO | C_AI | C_FI | C_SU, 0, 0, 0, 0}); // SUB
+    /* Initialize all different instructions and their microcodes */
+    for (uint16_t opcode = 0; opcode < 0x100; opcode++)
+        setBuiltinMicrocode(opcode);
+}
 
-    auto tab = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_AO | C_BI, 0, 0, 0, 0}); // TAB
-    auto tba = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_BO | C_AI, 0, 0, 0, 0}); // TBA
-    auto tao = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_AO | C_OI, 0, 0, 0, 0}); // TAO
-    auto tbo = std::initializer_list<uint16_t>({C_CO | C_MI, C_RO | C_IRI | C_CE, C_BO | C_OI, 0, 0, 0, 0}); // TBO
+template <typename Model>
+void BasicCpuMicrocode<Model>::setBuiltinMicrocode(uint8_t opcode)
+{
+    for (uint8_t flags = 0; flags < Model::FlagStates; flags++)
+        memset(UCODE[flags][opcode], 0, sizeof(UCODE[flags][opcode]));
+
+    STEPS[opcode] = MaxInstructionStep + 1;
+
+    switch (opcode)
+    {
+    case NOP: setMicrocode(NOP, {C_CO | C_MI, C_RO | C_IRI | C_CE}); break;
+    case HLT: setMicrocode(HLT, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_HLT}); break;
+    case PAG: setMicrocode(PAG, {C_CO | C_MI, C_RO | C_IRI | C_CE}); break;
+
+    case JMP: setMicrocode(JMP, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_JMP | C_CE}); break;
+    case JMC: setMicrocode(JMC, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_CE}); break;
+    case JMZ: setMicrocode(JMZ, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_CE}); break;
+    case JNZ: setMicrocode(JNZ, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_JMP | C_CE}); break;
+
+    case LDA: setMicrocode(LDA, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_MI | C_CE, C_RO | C_AI}); break;
+    case LDB: setMicrocode(LDB, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_MI | C_CE, C_RO | C_BI}); break;
+    case STA: setMicrocode(STA, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_MI | C_CE, C_AO | C_RI}); break;
+    case STB: setMicrocode(STB, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_MI | C_CE, C_BO | C_RI}); break;
+    case STE: setMicrocode(STE, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_CO | C_MI, C_RO | C_MI | C_CE, C_EO | C_RI}); break;
+
+    case ADD: setMicrocode(ADD, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_EO | C_AI | C_FI}); break;
+    case SUB: setMicrocode(SUB, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_EO | C_AI | C_FI | C_SU}); break;
+
+    case TAB: setMicrocode(TAB, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_AO | C_BI}); break;
+    case TBA: setMicrocode(TBA, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_BO | C_AI}); break;
+    case TAO: setMicrocode(TAO, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_AO | C_OI}); break;
+    case TBO: setMicrocode(TBO, {C_CO | C_MI, C_RO | C_IRI | C_CE, C_BO | C_OI}); break;
+    }
+
+    /* Setup the conditional jumps in the tables where their flag is set, further flag bits don't change them */
+    for (uint8_t flags = 0; flags < Model::FlagStates; flags++)
+    {
+        // Setup command for jump when carry
+        if (opcode == JMC && (flags & FLAGS_Z0C1))
+            UCODE[flags][JMC][JumpStep] = C_RO | C_JMP | C_CE;
+
+        // Setup commands for jump when zero and jump when not zero
+        if (opcode == JMZ && (flags & FLAGS_Z1C0))
+            UCODE[flags][JMZ][JumpStep] = C_RO | C_JMP | C_CE;
+
+        if (opcode == JNZ && (flags & FLAGS_Z1C0))
+            UCODE[flags][JNZ][JumpStep] = C_CE;
+    }
+}
 
-    // ZF = 0, CF = 0
-    std::copy(nop.begin(), nop.end(), UCODE[FLAGS_Z0C0][NOP]);
-    std::copy(hlt.begin(), hlt.end(), UCODE[FLAGS_Z0C0][HLT]);
+template <typename Model>
+void BasicCpuMicrocode<Model>::setMicrocode(uint8_t opcode, std::initializer_list<ControlWord> controlWords)
+{
+    for (uint8_t flags = 0; flags < Model::FlagStates; flags++)
+        std::copy(controlWords.begin(), controlWords.end(), UCODE[flags][opcode]);
+}
 
-    std::copy(jmp.begin(), jmp.end(), UCODE[FLAGS_Z0C0][JMP]);
-    std::copy(jmc.begin(), jmc.end(), UCODE[FLAGS_Z0C0][JMC]);
-    std::copy(jmz.begin(), jmz.end(), UCODE[FLAGS_Z0C0][JMZ]);
-    std::copy(jnz.begin(), jnz.end(), UCODE[FLAGS_Z0C0][JNZ]);
+template <typename Model>
+void BasicCpuMicrocode<Model>::applyBank(uint8_t bank, Entry entries[], uint8_t count)
+{
+    // Restore the built in microcode of the instructions the last bank changed, this runs between two clock edges
+    for (uint8_t i = 0; i < bankOpcodeCount; i++)
+        setBuiltinMicrocode(bankOpcodes[i]);
 
-    std::copy(lda.begin(), lda.end(), UCODE[FLAGS_Z0C0][LDA]);
-    std::copy(ldb.begin(), ldb.end(), UCODE[FLAGS_Z0C0][LDB]);
-    std::copy(sta.begin(), sta.end(), UCODE[FLAGS_Z0C0][STA]);
-    std::copy(stb.begin(), stb.end(), UCODE[FLAGS_Z0C0][STB]);
-    std::copy(ste.begin(), ste.end(), UCODE[FLAGS_Z0C0][STE]);
+    bankOpcodeCount = 0;
 
-    std::copy(add.begin(), add.end(), UCODE[FLAGS_Z0C0][ADD]);
-    std::copy(sub.begin(), sub.end(), UCODE[FLAGS_Z0C0][SUB]);
+    // Overwrite the microcode of all instructions defined by the bank
+    for (uint8_t i = 0; i < count && i < MaxBankEntries; i++)
+    {
+        Entry &entry = entries[i];
 
-    std::copy(tab.begin(), tab.end(), UCODE[FLAGS_Z0C0][TAB]);
-    std::copy(tba.begin(), tba.end(), UCODE[FLAGS_Z0C0][TBA]);
-    std::copy(tao.begin(), tao.end(), UCODE[FLAGS_Z0C0][TAO]);
-    std::copy(tbo.begin(), tbo.end(), UCODE[FLAGS_Z0C0][TBO]);
+        for (uint8_t flags = 0; flags < Model::FlagStates; flags++)
+            memcpy(UCODE[flags][entry.opcode], entry.controlWords[flags], sizeof(entry.controlWords[flags]));
 
-    /* Copy the default microcode table to the specific tables when flags are active */
-    memcpy(UCODE[FLAGS_Z0C1], UCODE[FLAGS_Z0C0], sizeof(UCODE[FLAGS_Z0C0])); // ZF = 0, CF = 1
+        STEPS[entry.opcode] = entry.steps;
+        bankOpcodes[bankOpcodeCount++] = entry.opcode;
+    }
 
-    // Setup command for jump when carry
-    UCODE[FLAGS_Z0C1][JMC][4] = C_RO | C_JMP | C_CE;
+    activeBank = bank;
+}
 
-    memcpy(UCODE[FLAGS_Z1C0], UCODE[FLAGS_Z0C0], sizeof(UCODE[FLAGS_Z0C0])); // ZF = 1, CF = 0
+template <typename Model>
+String BasicCpuMicrocode<Model>::getBankPath(uint8_t bank)
+{
+    return String(F("/ucode/bank")) + bank + F(".bin");
+}
 
-    // Setup commands for jump when zero and jump when not zero
-    UCODE[FLAGS_Z1C0][JMZ][4] = C_RO | C_JMP | C_CE;
-    UCODE[FLAGS_Z1C0][JNZ][4] = C_CE;
+template <typename Model>
+boolean BasicCpuMicrocode<Model>::saveBank(uint8_t bank, Entry entries[], uint8_t count)
+{
+    if (bank == 0 || bank >= MaxBanks || count > MaxBankEntries)
+        return false;
+
+    // Write into a temporary file first, so a failed upload never leaves a broken bank behind
+    String path = getBankPath(bank);
+    String tempPath = path + F(".tmp");
+
+    File file = LittleFS.open(tempPath, "w");
+    if (!file)
+        return false;
+
+    // The entries only fit boards with the same step counter, flags and control word
+    const uint8_t model[] = {Model::MaxSteps, Model::FlagBits, Model::ControlBytes};
+
+    size_t written = file.write(BANK_MAGIC, sizeof(BANK_MAGIC));
+    written += file.write(model, sizeof(model));
+    written += file.write(count);
+    written += file.write((uint8_t *)entries, sizeof(Entry) * count);
+    file.close();
+
+    if (written != sizeof(BANK_MAGIC) + sizeof(model) + 1 + sizeof(Entry) * count)
+    {
+        LittleFS.remove(tempPath);
+        return false;
+    }
+
+    LittleFS.remove(path);
+    return LittleFS.rename(tempPath, path);
+}
 
-    memcpy(UCODE[FLAGS_Z1C1], UCODE[FLAGS_Z0C0], sizeof(UCODE[FLAGS_Z0C0])); // ZF = 1, CF = 1
+template <typename Model>
+int BasicCpuMicrocode<Model>::loadBank(uint8_t bank, Entry entries[], uint8_t maxCount)
+{
+    if (bank == 0 || bank >= MaxBanks)
+        return -1;
+
+    File file = LittleFS.open(getBankPath(bank), "r");
+    if (!file)
+        return -1;
+
+    // Check the header of the bank file, banks of another board revision are rejected
+    const uint8_t model[] = {Model::MaxSteps, Model::FlagBits, Model::ControlBytes};
+
+    uint8_t header[sizeof(BANK_MAGIC) + sizeof(model) + 1];
+    if (file.read(header, sizeof(header)) != sizeof(header) || memcmp(header, BANK_MAGIC, sizeof(BANK_MAGIC)) != 0 ||
+        memcmp(header + sizeof(BANK_MAGIC), model, sizeof(model)) != 0)
+    {
+        file.close();
+        return -1;
+    }
+
+    uint8_t count = header[sizeof(BANK_MAGIC) + sizeof(model)];
+    if (count > maxCount)
+    {
+        file.close();
+        return -1;
+    }
+
+    size_t read = file.read((uint8_t *)entries, sizeof(Entry) * count);
+    file.close();
+
+    if (read != sizeof(Entry) * count)
+        return -1;
+
+    // Validate the entries, so a broken file can't write outside of the UCODE structure
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (entries[i].steps == 0 || entries[i].steps > MaxCustomSteps)
+            return -1;
+    }
+
+    return count;
+}
 
-    // Setup command for jump when carry
-    UCODE[FLAGS_Z1C1][JMC][4] = C_RO | C_JMP | C_CE;
+template <typename Model>
+boolean BasicCpuMicrocode<Model>::removeBank(uint8_t bank)
+{
+    if (bank == 0 || bank >= MaxBanks)
+        return false;
 
-    // Setup commands for jump when zero and jump when not zero
-    UCODE[FLAGS_Z1C1][JMZ][4] = C_RO | C_JMP | C_CE;
-    UCODE[FLAGS_Z1C1][JNZ][4] = C_CE;
+    return LittleFS.remove(getBankPath(bank));
 }
 
-uint16_t CpuMicrocode::getControlWord(uint8_t instruction, uint8_t flags, uint8_t step)
+template <typename Model>
+boolean BasicCpuMicrocode<Model>::bankExists(uint8_t bank)
 {
-    return UCODE[flags][instruction][step];
-}
\ No newline at end of file
+    if (bank == 0 || bank >= MaxBanks)
+        return false;
+
+    return LittleFS.exists(getBankPath(bank));
+}
+
+#ifdef ARDUINO
+// Compile the microcode for the board the firmware is built for
+template class BasicCpuMicrocode<DefaultCpuModel>;
+#else
+// Host builds compile the microcode for all board revisions
+template class BasicCpuMicrocode<CpuModelBreadboard>;
+template class BasicCpuMicrocode<CpuModelRev1>;
+template class BasicCpuMicrocode<CpuModelRev2>;
+#endif
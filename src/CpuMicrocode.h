@@ -1,27 +1,112 @@
 #include <Arduino.h>
 
 #include <CpuDefinitions.h>
+#include <CpuModel.h>
+
+#include <memory>
+#include <type_traits>
 
 #ifndef CPU_MICRO_CODE_H
 #define CPU_MICRO_CODE_H
 
+/* Holds the microcode of a single instruction inside a microcode bank. */
+template <typename Model>
+struct BasicMicrocodeEntry
+{
+    uint8_t opcode;
+    uint8_t steps;
+    typename Model::ControlWord controlWords[Model::FlagStates][Model::MaxSteps];
+};
+
 /* Class which manages all microcode for the different instructions. */
-class CpuMicrocode
+template <typename Model>
+class BasicCpuMicrocode
 {
+public:
+
+    typedef typename Model::ControlWord ControlWord;
+    typedef BasicMicrocodeEntry<Model> Entry;
+
 private:
 
-    uint16_t UCODE[0x04][0xFF][0x07]{0};
+    /* The microcode of all opcodes for one flag state, one row for every opcode, so any instruction register value stays inside the table. */
+    typedef ControlWord Table[0x100][Model::MaxSteps];
+
+    /* Every further flag bit doubles the tables, boards with more than two get them from the heap, so the global controller stays small. */
+    static const boolean TablesOnHeap = Model::FlagBits > 0x02;
+
+    typename std::conditional<TablesOnHeap, std::unique_ptr<Table[]>, Table[Model::FlagStates]>::type UCODE{};
+
+    /* The number of steps of each instruction before the step counter wraps around. */
+    uint8_t STEPS[0x100]{0};
+
+    uint8_t activeBank = 0;
+
+    /* The opcodes the active bank overwrites, one per bank entry, they get restored when another bank is applied. */
+    uint8_t bankOpcodes[0x10]{0};
+    uint8_t bankOpcodeCount = 0;
+
+    /* This copies the given control words into the microcode of the instruction in all flag tables. */
+    void setMicrocode(uint8_t opcode, std::initializer_list<ControlWord> controlWords);
+
+    /* This sets the built in microcode of the given opcode, undefined opcodes get cleared. */
+    void setBuiltinMicrocode(uint8_t opcode);
+
+    /* Returns the flash file path of the given microcode bank. */
+    static String getBankPath(uint8_t bank);
 
 public:
 
-    /* The maximum number of steps each microcode consists of. */
-    const uint8_t MaxInstructionStep = 0b100;
+    /* The last step of the built in instructions, the step counter wraps around after it. */
+    static const uint8_t MaxInstructionStep = Model::BuiltinSteps - 1;
+
+    /* The step in which the conditional jumps load the program counter or skip their operand. */
+    static const uint8_t JumpStep = MaxInstructionStep;
+
+    static_assert(JumpStep < Model::MaxSteps, "The conditional jumps have to fit into the step counter of the board");
+
+    /* The maximum number of steps a custom instruction can consist of. */
+    static const uint8_t MaxCustomSteps = Model::MaxSteps;
 
-    /* This initializes the UCODE structure with the microcodes for each instruction. */
+    /* The number of microcode banks, bank 0 is the built in microcode and can't be overwritten. */
+    static const uint8_t MaxBanks = 0x08;
+
+    /* The maximum number of instructions a single microcode bank can define. */
+    static const uint8_t MaxBankEntries = 0x10;
+
+    /* This initializes the UCODE structure with the microcodes for each instruction, the tables get allocated on the first call if they live on the heap. */
     void init();
 
     /* This returns the control word for the given instructions step when the given flags are active. */
-    uint16_t getControlWord(uint8_t instruction, uint8_t flags, uint8_t step);
+    ControlWord getControlWord(uint8_t instruction, uint8_t flags, uint8_t step)
+    {
+        // Only the flag bits of the board select a microcode table
+        return UCODE[flags & (Model::FlagStates - 1)][instruction][step];
+    }
+
+    /* This returns the number of steps the given instruction consists of. */
+    uint8_t getInstructionSteps(uint8_t instruction) { return STEPS[instruction]; }
+
+    /* This restores the built in microcode of the instructions the active bank changed and applies the given entries on top of it. */
+    void applyBank(uint8_t bank, Entry entries[], uint8_t count);
+
+    /* Returns the currently active microcode bank. */
+    uint8_t getActiveBank() { return activeBank; }
+
+    /* This stores the given entries as microcode bank in flash. */
+    static boolean saveBank(uint8_t bank, Entry entries[], uint8_t count);
+
+    /* This reads the given microcode bank from flash and returns the number of entries read or -1 on failure. */
+    static int loadBank(uint8_t bank, Entry entries[], uint8_t maxCount);
+
+    /* This removes the given microcode bank from flash. */
+    static boolean removeBank(uint8_t bank);
+
+    /* Returns if the given microcode bank is stored in flash. */
+    static boolean bankExists(uint8_t bank);
 };
 
-#endif
\ No newline at end of file
+typedef BasicMicrocodeEntry<DefaultCpuModel> MicrocodeEntry;
+typedef BasicCpuMicrocode<DefaultCpuModel> CpuMicrocode;
+
+#endif
@@ -0,0 +1,53 @@
+#include <Arduino.h>
+
+#ifndef CPU_MODEL_H
+#define CPU_MODEL_H
+
+/* Describes a revision of the cpu hardware. The microcode, the cpu controller and the emulator get compiled
+ * for it, so all sizes are constants in their hot paths. */
+template <uint16_t ramSize, uint8_t maxSteps, uint8_t flagBits, typename ControlWordType = uint16_t>
+struct CpuModel
+{
+    /* The number of steps of the built in instructions, they were written for the step counter of the first breadboard build. */
+    static const uint8_t BuiltinSteps = 0x05;
+
+    static_assert(ramSize >= 0x02 && ramSize <= 0x100 && (ramSize & (ramSize - 1)) == 0, "RAM size has to be a power of two up to 256 bytes");
+    static_assert(maxSteps >= BuiltinSteps, "The built in instructions need five steps");
+    static_assert(flagBits >= 0x02 && flagBits <= 0x03, "Zero and carry flag are needed, the microcode tables double with every further flag bit");
+
+    /* Bytes of RAM, addresses wrap around at its end. */
+    static const uint16_t RamSize = ramSize;
+    static const uint8_t AddressMask = ramSize - 1;
+
+    /* The size of the largest program which can be loaded at once. */
+    static const uint8_t MaxCodeSize = ramSize > 0xFF ? 0xFF : ramSize;
+
+    /* The number of steps a single instruction can consist of. */
+    static const uint8_t MaxSteps = maxSteps;
+
+    /* The number of flag bits which select a microcode table. */
+    static const uint8_t FlagBits = flagBits;
+    static const uint8_t FlagStates = 1 << flagBits;
+
+    /* The control word, it gets shifted out to one 74HC595 per byte. */
+    typedef ControlWordType ControlWord;
+    static const uint8_t ControlBytes = sizeof(ControlWordType);
+};
+
+/* The first breadboard build with 16 bytes of RAM. */
+typedef CpuModel<0x10, 0x05, 0x02> CpuModelBreadboard;
+
+/* The current board with 256 bytes of RAM and up to seven steps per instruction. */
+typedef CpuModel<0x100, 0x07, 0x02> CpuModelRev1;
+
+/* The board with an eight step counter and a negative flag, its 32KB of microcode tables get allocated from the heap. */
+typedef CpuModel<0x100, 0x08, 0x03> CpuModelRev2;
+
+// The board the firmware is built for, select another one with -D CPU_MODEL=CpuModelRev2
+#ifndef CPU_MODEL
+#define CPU_MODEL CpuModelRev1
+#endif
+
+typedef CPU_MODEL DefaultCpuModel;
+
+#endif
@@ -0,0 +1,41 @@
+#include "CpuProfiler.h"
+
+void CpuProfiler::reset()
+{
+    memset(instructions, 0, sizeof(instructions));
+    memset(cycles, 0, sizeof(cycles));
+    memset(wastedSteps, 0, sizeof(wastedSteps));
+    memset(flagCycles, 0, sizeof(flagCycles));
+    memset(pcCounts, 0, sizeof(pcCounts));
+
+    totalCycles = 0;
+    totalInstructions = 0;
+    totalWastedSteps = 0;
+    jumps = 0;
+}
+
+uint8_t CpuProfiler::getHotSpots(uint8_t pcs[], uint8_t size)
+{
+    uint8_t found = 0;
+
+    // Insertion sort of all fetched program counters, only the top entries are kept
+    for (uint16_t pc = 0; pc < 0x100; pc++)
+    {
+        if (pcCounts[pc] == 0)
+            continue;
+
+        uint8_t index = found < size ? found++ : size;
+        while (index > 0 && pcCounts[pcs[index - 1]] < pcCounts[pc])
+        {
+            if (index < size)
+                pcs[index] = pcs[index - 1];
+
+            index--;
+        }
+
+        if (index < size)
+            pcs[index] = pc;
+    }
+
+    return found;
+}
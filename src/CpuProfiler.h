@@ -0,0 +1,90 @@
+#include <Arduino.h>
+
+#ifndef CPU_PROFILER_H
+#define CPU_PROFILER_H
+
+/* Class which counts where the cpu spends its clock cycles. */
+class CpuProfiler
+{
+private:
+
+    /* Executed instructions, clock cycles and all-zero control words of each instruction. */
+    uint32_t instructions[0x100]{0};
+    uint32_t cycles[0x100]{0};
+    uint32_t wastedSteps[0x100]{0};
+
+    /* Clock cycles spent in each flag state. */
+    uint32_t flagCycles[0x04]{0};
+
+    /* Instruction fetches at each estimated program counter. */
+    uint32_t pcCounts[0x100]{0};
+
+    uint32_t totalCycles = 0;
+    uint32_t totalInstructions = 0;
+    uint32_t totalWastedSteps = 0;
+    uint32_t jumps = 0;
+
+public:
+
+    /* This clears all counters. */
+    void reset();
+
+    /* This counts a single instruction step with the given control word. */
+    void recordStep(uint8_t instruction, uint8_t flags, uint16_t controlWord)
+    {
+        totalCycles++;
+        flagCycles[flags & 0x03]++;
+
+        if (controlWord == 0)
+        {
+            totalWastedSteps++;
+            wastedSteps[instruction]++;
+        }
+    }
+
+    /* This counts a completed instruction and the number of steps it took. */
+    void recordInstruction(uint8_t instruction, uint8_t steps)
+    {
+        totalInstructions++;
+        instructions[instruction]++;
+        cycles[instruction] += steps;
+    }
+
+    /* This counts an instruction fetch at the given program counter. */
+    void recordFetch(uint8_t pc) { pcCounts[pc]++; }
+
+    /* This counts a taken jump. */
+    void recordJump() { jumps++; }
+
+    /* Returns the number of executed instructions of the given opcode. */
+    uint32_t getInstructions(uint8_t instruction) { return instructions[instruction]; }
+
+    /* Returns the clock cycles spent in the given opcode. */
+    uint32_t getCycles(uint8_t instruction) { return cycles[instruction]; }
+
+    /* Returns the number of all-zero instruction steps of the given opcode. */
+    uint32_t getWastedSteps(uint8_t instruction) { return wastedSteps[instruction]; }
+
+    /* Returns the clock cycles spent in the given flag state. */
+    uint32_t getFlagCycles(uint8_t flags) { return flagCycles[flags & 0x03]; }
+
+    /* Returns the number of instruction fetches at the given program counter. */
+    uint32_t getPcCount(uint8_t pc) { return pcCounts[pc]; }
+
+    /* Returns the total number of clock cycles. */
+    uint32_t getTotalCycles() { return totalCycles; }
+
+    /* Returns the total number of executed instructions. */
+    uint32_t getTotalInstructions() { return totalInstructions; }
+
+    /* Returns the total number of all-zero instruction steps. */
+    uint32_t getTotalWastedSteps() { return totalWastedSteps; }
+
+    /* Returns the number of taken jumps. */
+    uint32_t getJumps() { return jumps; }
+
+    /* This writes the program counters with the most fetches into the given buffer and returns how many were found. */
+    uint8_t getHotSpots(uint8_t pcs[], uint8_t size);
+};
+
+#endif
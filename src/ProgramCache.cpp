@@ -0,0 +1,236 @@
+#include <LittleFS.h>
+
+#include "ProgramCache.h"
+
+// Header of the program cache index file: 'P', 'C', version
+static const uint8_t INDEX_MAGIC[] = {'P', 'C', 0x01};
+static const char INDEX_PATH[] = "/programs/index";
+
+void ProgramCache::init()
+{
+    count = 0;
+    autoload = false;
+
+    File file = LittleFS.open(INDEX_PATH, "r");
+    if (!file)
+        return;
+
+    // Header, autoload setting and number of programs
+    uint8_t header[sizeof(INDEX_MAGIC) + 2];
+    if (file.read(header, sizeof(header)) != sizeof(header) || memcmp(header, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0)
+    {
+        file.close();
+        return;
+    }
+
+    autoload = header[sizeof(INDEX_MAGIC)];
+    uint8_t size = header[sizeof(INDEX_MAGIC) + 1];
+    if (size > MaxPrograms)
+        size = MaxPrograms;
+
+    if (file.read((uint8_t *)hashes, sizeof(uint64_t) * size) == sizeof(uint64_t) * size)
+        count = size;
+
+    file.close();
+}
+
+boolean ProgramCache::writeIndex()
+{
+    File file = LittleFS.open(INDEX_PATH, "w");
+    if (!file)
+        return false;
+
+    size_t written = file.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    written += file.write(autoload);
+    written += file.write(count);
+    written += file.write((uint8_t *)hashes, sizeof(uint64_t) * count);
+    file.close();
+
+    return written == sizeof(INDEX_MAGIC) + 2 + sizeof(uint64_t) * count;
+}
+
+String ProgramCache::getProgramPath(uint64_t hash)
+{
+    return String(F("/programs/")) + hashToString(hash) + F(".bin");
+}
+
+int ProgramCache::indexOf(uint64_t hash)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (hashes[i] == hash)
+            return i;
+    }
+
+    return -1;
+}
+
+boolean ProgramCache::touch(uint64_t hash)
+{
+    int index = indexOf(hash);
+
+    // Already the most recently used program, nothing to write
+    if (index == 0)
+        return true;
+
+    // Reordering cached programs only matters for the program loaded after boot, the order is kept in RAM otherwise
+    boolean changed = index < 0 || autoload;
+
+    if (index < 0)
+    {
+        // Evict the least recently used program
+        if (count >= MaxPrograms)
+        {
+            LittleFS.remove(getProgramPath(hashes[count - 1]));
+            count--;
+        }
+
+        index = count;
+        count++;
+    }
+
+    // Move all more recently used programs back by one
+    memmove(hashes + 1, hashes, sizeof(uint64_t) * index);
+    hashes[0] = hash;
+
+    return !changed || writeIndex();
+}
+
+boolean ProgramCache::store(uint8_t buffer[], uint8_t size, uint64_t &programHash)
+{
+    programHash = hash(buffer, size);
+
+    // Only write programs which aren't cached already
+    if (indexOf(programHash) < 0)
+    {
+        File file = LittleFS.open(getProgramPath(programHash), "w");
+        if (!file)
+            return false;
+
+        size_t written = file.write(buffer, size);
+        file.close();
+
+        if (written != size)
+        {
+            LittleFS.remove(getProgramPath(programHash));
+            return false;
+        }
+    }
+
+    return touch(programHash);
+}
+
+int ProgramCache::load(uint64_t hash, uint8_t buffer[], uint8_t maxSize)
+{
+    if (indexOf(hash) < 0)
+        return -1;
+
+    File file = LittleFS.open(getProgramPath(hash), "r");
+    if (!file)
+        return -1;
+
+    if (file.size() > maxSize)
+    {
+        file.close();
+        return -1;
+    }
+
+    int size = file.read(buffer, file.size());
+    file.close();
+
+    touch(hash);
+
+    return size;
+}
+
+int ProgramCache::loadLast(uint8_t buffer[], uint8_t maxSize)
+{
+    if (count == 0)
+        return -1;
+
+    return load(hashes[0], buffer, maxSize);
+}
+
+boolean ProgramCache::remove(uint64_t hash)
+{
+    int index = indexOf(hash);
+    if (index < 0)
+        return false;
+
+    LittleFS.remove(getProgramPath(hash));
+
+    // Close the gap in the hashes
+    memmove(hashes + index, hashes + index + 1, sizeof(uint64_t) * (count - index - 1));
+    count--;
+
+    return writeIndex();
+}
+
+void ProgramCache::setAutoload(boolean enabled)
+{
+    if (autoload == enabled)
+        return;
+
+    autoload = enabled;
+    writeIndex();
+}
+
+uint8_t ProgramCache::getSize(uint64_t hash)
+{
+    File file = LittleFS.open(getProgramPath(hash), "r");
+    if (!file)
+        return 0;
+
+    uint8_t size = file.size();
+    file.close();
+
+    return size;
+}
+
+uint64_t ProgramCache::hash(uint8_t buffer[], uint8_t size)
+{
+    // Include the size, so programs only differing in trailing zeros get different hashes
+    uint64_t value = 0xCBF29CE484222325 ^ size;
+
+    for (uint8_t i = 0; i < size; i++)
+    {
+        value ^= buffer[i];
+        value *= 0x100000001B3;
+    }
+
+    return value;
+}
+
+String ProgramCache::hashToString(uint64_t hash)
+{
+    char text[17];
+    snprintf(text, sizeof(text), "%08lx%08lx", (unsigned long)(hash >> 32), (unsigned long)(hash & 0xFFFFFFFF));
+
+    return String(text);
+}
+
+boolean ProgramCache::stringToHash(const String &text, uint64_t &hash)
+{
+    if (text.length() != 16)
+        return false;
+
+    hash = 0;
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        char c = text[i];
+        uint8_t digit;
+
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            return false;
+
+        hash = (hash << 4) | digit;
+    }
+
+    return true;
+}
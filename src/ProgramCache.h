@@ -0,0 +1,75 @@
+#include <Arduino.h>
+
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+
+/* Class which keeps the most recently used programs in flash, addressed by the hash of their content. */
+class ProgramCache
+{
+private:
+
+    /* The hashes of all cached programs, the most recently used first. */
+    uint64_t hashes[0x08]{0};
+    uint8_t count = 0;
+
+    boolean autoload = false;
+
+    /* Returns the flash file path of the program with the given hash. */
+    static String getProgramPath(uint64_t hash);
+
+    /* Returns the index of the given hash or -1 if the program isn't cached. */
+    int indexOf(uint64_t hash);
+
+    /* Moves the given hash to the front of the cache and evicts the least recently used program when full, returns false if the index couldn't be written.
+     * The new order is only written when programs were added or evicted or the autoloaded program changed. */
+    boolean touch(uint64_t hash);
+
+    /* Writes the hashes and settings to flash. */
+    boolean writeIndex();
+
+public:
+
+    /* The maximum number of programs kept in flash. */
+    static const uint8_t MaxPrograms = 0x08;
+
+    /* This reads the index of all cached programs from flash. */
+    void init();
+
+    /* This stores the given program in flash if it isn't cached already and sets its hash, returns false if it couldn't be written. */
+    boolean store(uint8_t buffer[], uint8_t size, uint64_t &programHash);
+
+    /* This reads the program with the given hash and returns its size or -1 if it isn't cached. */
+    int load(uint64_t hash, uint8_t buffer[], uint8_t maxSize);
+
+    /* This reads the most recently used program and returns its size or -1 if there is none. */
+    int loadLast(uint8_t buffer[], uint8_t maxSize);
+
+    /* This removes the program with the given hash from flash. */
+    boolean remove(uint64_t hash);
+
+    /* Sets if the most recently used program is loaded into RAM after boot. */
+    void setAutoload(boolean enabled);
+
+    /* Returns if the most recently used program is loaded into RAM after boot. */
+    boolean getAutoload() { return autoload; }
+
+    /* Returns the number of cached programs. */
+    uint8_t getCount() { return count; }
+
+    /* Returns the hash of the cached program at the given index, the most recently used first. */
+    uint64_t getHash(uint8_t index) { return hashes[index]; }
+
+    /* Returns the size of the cached program with the given hash. */
+    uint8_t getSize(uint64_t hash);
+
+    /* Calculates the FNV-1a hash of the given program. */
+    static uint64_t hash(uint8_t buffer[], uint8_t size);
+
+    /* Converts a hash into its hex representation. */
+    static String hashToString(uint64_t hash);
+
+    /* Converts a hex representation into a hash, returns false if it isn't valid. */
+    static boolean stringToHash(const String &text, uint64_t &hash);
+};
+
+#endif
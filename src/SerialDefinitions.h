@@ -0,0 +1,81 @@
+/*
+ * Here are all constants of the binary serial protocol defined.
+ *
+ * Every frame in both directions looks like:
+ * SYNC | command | length | payload[length] | CRC16 high | CRC16 low
+ *
+ * The CRC16-CCITT covers the command, length and payload. Responses use the
+ * command of the request with the response bit set, errors are sent with the
+ * error command and the failed command plus an error code as payload.
+ * 
+ */
+
+#ifndef SERIAL_DEFINITIONS
+#define SERIAL_DEFINITIONS
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ##############################################
+// Here is the framing defined.
+// ##############################################
+// Baud rate after boot, can be raised with a build flag or at runtime with the set baud command
+#ifndef SERIAL_BAUD
+#define SERIAL_BAUD 115200
+#endif
+
+#define SERIAL_MIN_BAUD 9600
+#define SERIAL_MAX_BAUD 3000000
+
+#define SERIAL_SYNC 0x7E
+#define SERIAL_MAX_PAYLOAD 0xFF
+#define SERIAL_FRAME_OVERHEAD 0x05
+#define SERIAL_FRAME_TIMEOUT 100 // Milliseconds until a partly received frame is dropped
+
+#define SERIAL_RESPONSE 0x80 // Set in the command of every response
+#define SERIAL_ERROR 0xFF    // Command of error responses
+
+// ##############################################
+// Here are all different commands defined.
+// ##############################################
+#define SERIAL_CMD_PING 0x01       // Echoes the payload
+#define SERIAL_CMD_GET_MODE 0x02   // -> mode
+#define SERIAL_CMD_SET_MODE 0x03   // mode -> mode
+#define SERIAL_CMD_LOAD_CODE 0x04  // code -> size, program cache hash
+#define SERIAL_CMD_GET_STATE 0x05  // -> instruction, flags, step, control word, code loaded, code size, loaded, pc, cycles
+#define SERIAL_CMD_GET_TRACE 0x06  // -> last executed steps, each instruction, flags, step, control word
+#define SERIAL_CMD_RESET 0x07      // -> instruction, flags, step
+#define SERIAL_CMD_SET_BAUD 0x08   // baud rate -> baud rate, switched after the response
+                                   // Multi byte values are sent most significant byte first
+#define SERIAL_CMD_SET_DEBUG 0x09  // enabled -> enabled
+
+// ##############################################
+// Here are all modes of the cpu controller defined.
+// ##############################################
+#define SERIAL_MODE_IDLE 0x00
+#define SERIAL_MODE_EXECUTE 0x01
+#define SERIAL_MODE_LOAD_CODE 0x02
+
+// ##############################################
+// Here are all error codes defined.
+// ##############################################
+#define SERIAL_ERR_UNKNOWN_COMMAND 0x01
+#define SERIAL_ERR_INVALID_PAYLOAD 0x02
+#define SERIAL_ERR_WRONG_MODE 0x03
+#define SERIAL_ERR_BUSY 0x04
+#define SERIAL_ERR_STORAGE 0x05
+
+/* This calculates the CRC16-CCITT of the given bytes. */
+static inline uint16_t serialCrc16(const uint8_t *data, size_t size, uint16_t crc = 0xFFFF)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include "SerialProtocol.h"
+
+void SerialProtocol::handle()
+{
+    // Give up on a partly received frame, the bytes after its sync byte might hold the start of another one
+    if (synced && millis() - frameStart > SERIAL_FRAME_TIMEOUT)
+    {
+        resync(0);
+        handleFrame();
+    }
+
+    while (Serial.available() > 0)
+    {
+        uint8_t c = Serial.read();
+
+        // Skip everything up to the next sync byte
+        if (!synced)
+        {
+            if (c == SERIAL_SYNC)
+            {
+                synced = true;
+                received = 0;
+                frameStart = millis();
+            }
+
+            continue;
+        }
+
+        frame[received++] = c;
+        handleFrame();
+    }
+}
+
+void SerialProtocol::handleFrame()
+{
+    // Command, length, payload and CRC
+    while (synced && received >= 2 && received >= frame[1] + SERIAL_FRAME_OVERHEAD - 1)
+    {
+        uint16_t size = frame[1] + SERIAL_FRAME_OVERHEAD - 1;
+
+        // Continue behind a valid frame, a broken one might have started at a sync byte inside of other data
+        resync(dispatchFrame() ? size : 0);
+    }
+}
+
+void SerialProtocol::resync(uint16_t start)
+{
+    // Search the remaining bytes for the next sync byte, so a frame starting inside of the dropped bytes isn't lost
+    for (uint16_t i = start; i < received; i++)
+    {
+        if (frame[i] == SERIAL_SYNC)
+        {
+            received -= i + 1;
+            memmove(frame, frame + i + 1, received);
+            frameStart = millis();
+
+            return;
+        }
+    }
+
+    synced = false;
+    received = 0;
+}
+
+boolean SerialProtocol::dispatchFrame()
+{
+    uint8_t length = frame[1];
+    uint16_t crc = (frame[length + 2] << 8) | frame[length + 3];
+
+    // Frames with a broken CRC are dropped, the host will time out and retry
+    if (crc != serialCrc16(frame, length + 2))
+        return false;
+
+    active = true;
+
+    if (handler != nullptr)
+        handler(frame[0], frame + 2, length);
+
+    return true;
+}
+
+void SerialProtocol::send(uint8_t command, const uint8_t payload[], uint8_t length)
+{
+    uint8_t header[] = {SERIAL_SYNC, command, length};
+
+    uint16_t crc = serialCrc16(header + 1, 2);
+    crc = serialCrc16(payload, length, crc);
+
+    uint8_t footer[] = {(uint8_t)(crc >> 8), (uint8_t)(crc & 0xFF)};
+
+    Serial.write(header, sizeof(header));
+    Serial.write(payload, length);
+    Serial.write(footer, sizeof(footer));
+}
+
+void SerialProtocol::sendError(uint8_t command, uint8_t error)
+{
+    uint8_t payload[] = {command, error};
+    send(SERIAL_ERROR, payload, sizeof(payload));
+}
@@ -0,0 +1,55 @@
+#include <Arduino.h>
+
+#include <SerialDefinitions.h>
+
+#ifndef SERIAL_PROTOCOL_H
+#define SERIAL_PROTOCOL_H
+
+/* Gets called for every received frame with a valid CRC. */
+typedef void (*SerialCommandHandler)(uint8_t command, uint8_t payload[], uint8_t length);
+
+/* Class which receives and sends the frames of the binary serial protocol. */
+class SerialProtocol
+{
+private:
+
+    SerialCommandHandler handler = nullptr;
+
+    /* The frame which is currently received, without the sync byte. */
+    uint8_t frame[SERIAL_MAX_PAYLOAD + SERIAL_FRAME_OVERHEAD];
+    uint16_t received = 0;
+    boolean synced = false;
+
+    unsigned long frameStart = 0;
+
+    /* Gets set once the first valid frame was received. */
+    boolean active = false;
+
+    /* This checks the CRC of the complete frame and passes it to the handler, returns false if the CRC is broken. */
+    boolean dispatchFrame();
+
+    /* This dispatches the received frame once it is complete, a broken one gets searched for the next sync byte. */
+    void handleFrame();
+
+    /* This continues with the next sync byte in the received bytes from the given index on. */
+    void resync(uint16_t start);
+
+public:
+
+    /* This sets the handler which gets called for every received frame. */
+    void begin(SerialCommandHandler commandHandler) { handler = commandHandler; }
+
+    /* This reads all available bytes and dispatches complete frames, it has to be called from the main loop. */
+    void handle();
+
+    /* This sends a frame with the given command and payload. */
+    void send(uint8_t command, const uint8_t payload[], uint8_t length);
+
+    /* This sends an error response for the given command. */
+    void sendError(uint8_t command, uint8_t error);
+
+    /* Returns if a valid frame was received since boot. */
+    boolean isActive() { return active; }
+};
+
+#endif
@@ -2,51 +2,203 @@
 
 #include "WiFiFunctions.h"
 
-/* This functions tries to connect to any of the given accessPoints wlan in the order they are given. */
-WiFiInfo WiFiConnect(WiFiInfo *accessPoints, int size)
+/* Time to wait for a connection to the cached access point, which skips the channel scan. */
+#define WIFI_FAST_TIMEOUT 3000
+
+/* Time to wait for a connection to an access point with a full scan. */
+#define WIFI_TIMEOUT 10000
+
+/* RTC memory block where the last good connection is cached, the first 32 blocks are used by the OTA bootloader. */
+#define WIFI_RTC_OFFSET 32
+
+/* Holds the last good connection, survives resets but not power cycles. */
+struct WiFiCache
+{
+  uint32_t crc;
+  uint8_t accessPoint;
+  uint8_t channel;
+  uint8_t bssid[6];
+};
+
+/* States of the background connection. */
+enum WiFiState
+{
+  WIFI_STATE_IDLE,
+  WIFI_STATE_CONNECTING,
+  WIFI_STATE_CONNECTED
+};
+
+static WiFiInfo *wifiAccessPoints = nullptr;
+static int wifiAccessPointCount = 0;
+
+static WiFiState wifiState = WIFI_STATE_IDLE;
+static int wifiAccessPoint = 0;
+static bool wifiFastConnect = false;
+static unsigned long wifiAttemptStart = 0;
+
+/* Gets cleared when the serial port is used for something else than the status output. */
+static bool wifiDebugOutput = true;
+
+/* This function calculates the CRC32 of the given bytes. */
+static uint32_t WiFiCrc32(const uint8_t *data, size_t size)
 {
-  while (WiFi.status() != WL_CONNECTED)
+  uint32_t crc = 0xFFFFFFFF;
+
+  for (size_t i = 0; i < size; i++)
   {
-    for (int i = 0; i < size; i++)
-    {
-      WiFi.disconnect();
+    crc ^= data[i];
+    for (uint8_t bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
 
-      // Connect to WiFi network
-      Serial.println();
-      Serial.println();
-      Serial.print("Connecting to ");
-      Serial.println(accessPoints[i].ssid);
+  return ~crc;
+}
 
-      WiFi.begin(accessPoints[i].ssid, accessPoints[i].wpa);
+/* This function reads the cached connection from RTC memory and returns if it is valid. */
+static bool WiFiReadCache(WiFiCache &cache)
+{
+  if (!ESP.rtcUserMemoryRead(WIFI_RTC_OFFSET, (uint32_t *)&cache, sizeof(cache)))
+    return false;
 
-      int wait = 0;
-      while (WiFi.status() != WL_CONNECTED)
-      {
-        delay(500);
-        Serial.print(".");
-        wait++;
-        if (wait > 20)
-        {
-          Serial.println();
-          Serial.println("Couldn't connect to WiFi...");
-          break;
-        }
-      }
+  return cache.crc == WiFiCrc32((uint8_t *)&cache + sizeof(cache.crc), sizeof(cache) - sizeof(cache.crc)) && cache.accessPoint < wifiAccessPointCount;
+}
+
+/* This function stores the current connection in RTC memory. */
+static void WiFiWriteCache()
+{
+  WiFiCache cache;
+
+  cache.accessPoint = wifiAccessPoint;
+  cache.channel = WiFi.channel();
+  memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+  cache.crc = WiFiCrc32((uint8_t *)&cache + sizeof(cache.crc), sizeof(cache) - sizeof(cache.crc));
+
+  ESP.rtcUserMemoryWrite(WIFI_RTC_OFFSET, (uint32_t *)&cache, sizeof(cache));
+}
+
+/* This function starts a connection attempt to the current access point. */
+static void WiFiStartAttempt()
+{
+  WiFiInfo &accessPoint = wifiAccessPoints[wifiAccessPoint];
+  WiFiCache cache;
+
+  WiFi.disconnect();
+
+  if (wifiDebugOutput)
+  {
+    Serial.println();
+    Serial.print("Connecting to ");
+    Serial.println(accessPoint.ssid);
+  }
+
+  // Connect directly to the cached access point and channel, this skips the scan
+  if (wifiFastConnect && WiFiReadCache(cache) && cache.accessPoint == wifiAccessPoint)
+    WiFi.begin(accessPoint.ssid, accessPoint.wpa, cache.channel, cache.bssid);
+  else
+  {
+    wifiFastConnect = false;
+    WiFi.begin(accessPoint.ssid, accessPoint.wpa);
+  }
+
+  wifiAttemptStart = millis();
+  wifiState = WIFI_STATE_CONNECTING;
+}
+
+/* This function starts connecting to any of the given accessPoints wlan in the background, the last good access point is tried first. */
+void WiFiConnectBegin(WiFiInfo *accessPoints, int size)
+{
+  wifiAccessPoints = accessPoints;
+  wifiAccessPointCount = size;
 
-      if (WiFi.status() == WL_CONNECTED)
+  if (size <= 0)
+    return;
+
+  // Don't write the WiFi config to flash on every connection attempt
+  WiFi.persistent(false);
+
+  // Lost connections are handled by WiFiConnectHandle, the SDK must not reconnect at the same time
+  WiFi.setAutoReconnect(false);
+
+  WiFiCache cache;
+  wifiFastConnect = WiFiReadCache(cache);
+  wifiAccessPoint = wifiFastConnect ? cache.accessPoint : 0;
+
+  WiFiStartAttempt();
+}
+
+/* This function drives the background connection, it returns true once right after a connection was established. */
+bool WiFiConnectHandle()
+{
+  if (wifiState == WIFI_STATE_IDLE)
+    return false;
+
+  bool connected = WiFi.status() == WL_CONNECTED;
+
+  if (wifiState == WIFI_STATE_CONNECTED)
+  {
+    // Start over with the last good access point when the connection was lost
+    if (!connected)
+    {
+      if (wifiDebugOutput)
       {
         Serial.println();
-        Serial.println("Succesfully connected!");
+        Serial.println("Lost WiFi connection...");
+      }
 
-        // Print the IP address
-        Serial.print("IP: ");
-        Serial.println(WiFi.localIP());
-        Serial.println();
+      wifiFastConnect = true;
+      WiFiStartAttempt();
+    }
 
-        return accessPoints[i];
-      }
+    return false;
+  }
+
+  if (connected)
+  {
+    if (wifiDebugOutput)
+    {
+      Serial.println();
+      Serial.println("Succesfully connected!");
+
+      // Print the IP address
+      Serial.print("IP: ");
+      Serial.println(WiFi.localIP());
+      Serial.println();
     }
+
+    WiFiWriteCache();
+    wifiState = WIFI_STATE_CONNECTED;
+
+    return true;
   }
 
-  return WiFiInfo{0};
+  // Try the next access point after a timeout, the cached one gets a shorter timeout
+  if (millis() - wifiAttemptStart > (wifiFastConnect ? WIFI_FAST_TIMEOUT : WIFI_TIMEOUT))
+  {
+    if (wifiDebugOutput)
+    {
+      Serial.println();
+      Serial.println("Couldn't connect to WiFi...");
+    }
+
+    // A failed fast connect retries the same access point with a full scan
+    if (!wifiFastConnect)
+      wifiAccessPoint = (wifiAccessPoint + 1) % wifiAccessPointCount;
+
+    wifiFastConnect = false;
+    WiFiStartAttempt();
+  }
+
+  return false;
+}
+
+/* This function returns if the background connection is established. */
+bool WiFiIsConnected()
+{
+  return wifiState == WIFI_STATE_CONNECTED;
+}
+
+/* This function enables or disables the status output on the serial port. */
+void WiFiSetDebugOutput(bool enabled)
+{
+  wifiDebugOutput = enabled;
 }
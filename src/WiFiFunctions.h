@@ -12,7 +12,16 @@ struct WiFiInfo
   const char *wpa;
 };
 
-/* This functions tries to connect to any of the given accessPoints wlan in the order they are given. */
-WiFiInfo WiFiConnect(WiFiInfo *accessPoints, int size);
+/* This function starts connecting to any of the given accessPoints wlan in the background, the last good access point is tried first. */
+void WiFiConnectBegin(WiFiInfo *accessPoints, int size);
 
-#endif
\ No newline at end of file
+/* This function drives the background connection, it returns true once right after a connection was established. */
+bool WiFiConnectHandle();
+
+/* This function returns if the background connection is established. */
+bool WiFiIsConnected();
+
+/* This function enables or disables the status output on the serial port. */
+void WiFiSetDebugOutput(bool enabled);
+
+#endif
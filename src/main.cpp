@@ -1,6 +1,7 @@
 #include <ESP8266WiFi.h>
 #include <ESP8266WebServer.h>
 #include <ESP8266mDNS.h>
+#include <LittleFS.h>
 
 #include <ArduinoJson.h>
 
@@ -9,6 +10,9 @@
 #include <PinDefinitions.h>
 #include <CpuDefinitions.h>
 #include <CpuController.h>
+#include <CpuJobQueue.h>
+#include <ProgramCache.h>
+#include <SerialProtocol.h>
 
 // All accesspoints in the order they should be tried
 WiFiInfo WiFiAccessPoints[3] = {{"FRITZBox Thomas 2,4 Ghz", "4858035152347806"},
@@ -25,6 +29,15 @@ static const char RESPONSE_JSON[] PROGMEM = "application/json";
 // Variables for the 8Bit cpu
 CpuController cpu;
 
+// Programs which get loaded and executed one after another
+CpuJobQueue jobs(cpu);
+
+// The most recently used programs in flash
+ProgramCache programs;
+
+// Binary control protocol on the serial port
+SerialProtocol serialProtocol;
+
 /* This returns the current mode of the cpu controller. */
 void getMode()
 {
@@ -48,6 +61,12 @@ void postMode()
 		return;
 	}
 
+	if (jobs.isBusy())
+	{
+		server.send(409, FPSTR(RESPONSE_TEXT), F("CPU is busy with a job!"));
+		return;
+	}
+
 	// Reset all modes
 	cpu.setExecuteMode(false);
 	cpu.setLoadCodeMode(false);
@@ -63,7 +82,30 @@ void postMode()
 	getMode();
 }
 
-/* This sets code the cpu controller should load into RAM. */
+/* This sends the response for code which was loaded into RAM. */
+void sendCodeResponse(uint8_t buffer[], uint8_t size, uint64_t hash)
+{
+	// Create the response text
+	String startMessage = F("Succesfully received code array of ");
+	String message = startMessage + size;
+
+	message += F(" byte(s).\n\tHash: ");
+	message += ProgramCache::hashToString(hash);
+	message += F("\n\tContent: { ");
+
+	for(uint8_t i = 0; i < size; i++)
+	{
+		message += "0x";
+		message += String(buffer[i], HEX);
+		message += ", ";
+	}
+
+	message += "}";
+
+	server.send(200, FPSTR(RESPONSE_TEXT), message);
+}
+
+/* This sets code the cpu controller should load into RAM, either from the body or from the program cache by its hash. */
 void postCode()
 {
 	// Check if the cpu is in load code mode 
@@ -73,6 +115,30 @@ void postCode()
 		return;
 	}
 
+	if (jobs.isBusy())
+	{
+		server.send(409, FPSTR(RESPONSE_TEXT), F("CPU is busy with a job!"));
+		return;
+	}
+
+	// Load a cached program without transferring it again
+	if (server.hasArg("hash"))
+	{
+		uint64_t hash;
+		uint8_t buffer[0xFF];
+
+		int size = ProgramCache::stringToHash(server.arg("hash"), hash) ? programs.load(hash, buffer, sizeof(buffer)) : -1;
+		if (size < 0)
+		{
+			server.send(404, FPSTR(RESPONSE_TEXT), F("Program not cached!"));
+			return;
+		}
+
+		cpu.loadCodeToRam(buffer, size);
+		sendCodeResponse(buffer, size, hash);
+		return;
+	}
+
 	//	Check if body was received
 	if (server.hasArg("plain") == false)
 	{
@@ -100,22 +166,162 @@ void postCode()
 	// Load code into RAM
 	cpu.loadCodeToRam(buffer, sizeof(buffer));
 
-	// Create the response text
-	String startMessage = F("Succesfully received code array of ");
-	String message = startMessage + sizeof(buffer);
+	// Keep the program in flash, so it can be loaded again by its hash
+	uint64_t hash;
+	if (!programs.store(buffer, sizeof(buffer), hash))
+	{
+		server.send(507, FPSTR(RESPONSE_TEXT), F("Code received, but couldn't be stored in flash!"));
+		return;
+	}
+
+	sendCodeResponse(buffer, sizeof(buffer), hash);
+}
+
+/* This returns all cached programs and the autoload setting. */
+void getPrograms()
+{
+	String buf;
+	DynamicJsonDocument doc(JSON_OBJECT_SIZE(2) + JSON_ARRAY_SIZE(ProgramCache::MaxPrograms) + ProgramCache::MaxPrograms * (JSON_OBJECT_SIZE(2) + 17));
 
-	message += F(" byte(s).\n\tContent: { ");
+	doc["autoload"] = programs.getAutoload();
 
-	for(uint8_t i = 0; i < sizeof(buffer); i++)
+	JsonArray array = doc.createNestedArray("programs");
+	for (uint8_t i = 0; i < programs.getCount(); i++)
 	{
-		message += "0x";
-		message += String(buffer[i], HEX);
-		message += ", ";
+		JsonObject program = array.createNestedObject();
+
+		program["hash"] = ProgramCache::hashToString(programs.getHash(i));
+		program["size"] = programs.getSize(programs.getHash(i));
 	}
 
-	message += "}";
+	serializeJson(doc, buf);
 
-	server.send(200, FPSTR(RESPONSE_TEXT), message);
+	server.send(200, FPSTR(RESPONSE_JSON), buf);
+}
+
+/* This sets if the most recently used program is loaded into RAM after boot. */
+void postPrograms()
+{
+	if (!server.hasArg("autoload"))
+	{
+		server.send(400, FPSTR(RESPONSE_TEXT), F("autoload argument missing!"));
+		return;
+	}
+
+	programs.setAutoload(server.arg("autoload") == "true");
+	getPrograms();
+}
+
+/* This removes a program from the program cache. */
+void deletePrograms()
+{
+	uint64_t hash;
+	if (!ProgramCache::stringToHash(server.arg("hash"), hash) || !programs.remove(hash))
+	{
+		server.send(404, FPSTR(RESPONSE_TEXT), F("Program not cached!"));
+		return;
+	}
+
+	getPrograms();
+}
+
+/* This returns all queued and finished jobs with their results. */
+void getJobs()
+{
+	String buf;
+	DynamicJsonDocument doc(JSON_OBJECT_SIZE(1) + JSON_ARRAY_SIZE(CpuJobQueue::MaxJobs) + CpuJobQueue::MaxJobs * JSON_OBJECT_SIZE(9));
+
+	doc["busy"] = jobs.isBusy();
+
+	JsonArray array = doc.createNestedArray("jobs");
+	for (uint8_t i = 0; i < CpuJobQueue::MaxJobs; i++)
+	{
+		const CpuJob &job = jobs.getJob(i);
+		if (job.state == JOB_FREE)
+			continue;
+
+		JsonObject entry = array.createNestedObject();
+
+		entry["id"] = job.id;
+		entry["state"] = CpuJobQueue::getStateName(job.state);
+		entry["codeSize"] = job.codeSize;
+		entry["cycles"] = job.cycles;
+		entry["loadTime"] = job.loadTime;
+		entry["executeTime"] = job.executeTime;
+		entry["flags"] = job.flags;
+		entry["pc"] = job.pc;
+	}
+
+	serializeJson(doc, buf);
+
+	server.send(200, FPSTR(RESPONSE_JSON), buf);
+}
+
+/* This queues programs, which are loaded and executed one after another without further requests. */
+void postJobs()
+{
+	//	Check if body was received
+	if (server.hasArg("plain") == false)
+	{
+		server.send(400, FPSTR(RESPONSE_TEXT), F("Body not received!"));
+		return;
+	}
+
+	// Deserialize body and check for deserialization errors, all programs of one request share 512 bytes
+	const size_t CAPACITY = JSON_ARRAY_SIZE(CpuJobQueue::MaxJobs) + CpuJobQueue::MaxJobs * JSON_OBJECT_SIZE(3) + JSON_ARRAY_SIZE(512);
+	DynamicJsonDocument doc(CAPACITY);
+	DeserializationError error = deserializeJson(doc, server.arg("plain"));
+	if (error)
+	{
+		String errorText(error.f_str());
+		server.send(400, FPSTR(RESPONSE_TEXT), "Deserialization error: " + errorText);
+		return;
+	}
+
+	// Each job is either a code array or an object with the code, cycle budget and timeout
+	JsonArray requested = doc.as<JsonArray>();
+
+	// Check all jobs before queueing any, so a rejected request doesn't leave some of its jobs behind
+	for (JsonVariant job : requested)
+	{
+		JsonArray array = job.is<JsonArray>() ? job.as<JsonArray>() : job["code"].as<JsonArray>();
+		if (array.size() == 0 || array.size() > 0xFF)
+		{
+			server.send(400, FPSTR(RESPONSE_TEXT), F("Invalid job code!"));
+			return;
+		}
+	}
+
+	if (requested.size() > jobs.getFreeSlots())
+	{
+		server.send(503, FPSTR(RESPONSE_TEXT), F("Job queue is full!"));
+		return;
+	}
+
+	String buf;
+	StaticJsonDocument<255> response;
+	JsonArray ids = response.createNestedArray("ids");
+
+	for (JsonVariant job : requested)
+	{
+		JsonArray array = job.is<JsonArray>() ? job.as<JsonArray>() : job["code"].as<JsonArray>();
+
+		uint8_t buffer[array.size()];
+		copyArray(array, buffer, array.size());
+
+		ids.add(jobs.add(buffer, sizeof(buffer), job["cycleBudget"] | (uint32_t)CpuJobQueue::DefaultCycleBudget, job["timeout"] | (uint32_t)CpuJobQueue::DefaultTimeout));
+	}
+
+	serializeJson(response, buf);
+
+	server.send(200, FPSTR(RESPONSE_JSON), buf);
+}
+
+/* This aborts the current job and removes all jobs. */
+void deleteJobs()
+{
+	jobs.clear();
+	getJobs();
 }
 
 /* This returns the current control word of the cpu controller. */
@@ -161,9 +367,484 @@ void getCodeLoadStatus()
 	server.send(200, FPSTR(RESPONSE_JSON), buf);
 }
 
+/* This returns the state of the overlay loader. */
+void getOverlay()
+{
+	String buf;
+	StaticJsonDocument<255> doc;
+
+	doc["overlayMode"] = cpu.getOverlayMode();
+	doc["overlaySize"] = cpu.getOverlaySize();
+	doc["segmentSize"] = cpu.getSegmentSize();
+	doc["segment"] = cpu.getSegment();
+	doc["paging"] = cpu.getPaging();
+	doc["pagedBytes"] = cpu.getPagedBytes();
+	doc["skippedBytes"] = cpu.getSkippedBytes();
+
+	serializeJson(doc, buf);
+
+	server.send(200, FPSTR(RESPONSE_JSON), buf);
+}
+
+/* This copies a part of a program image larger than the cpu RAM into the overlay buffer. */
+void postOverlay()
+{
+	//	Check if body was received
+	if (server.hasArg("plain") == false)
+	{
+		server.send(400, FPSTR(RESPONSE_TEXT), F("Body not received!"));
+		return;
+	}
+
+	// Deserialize body and check for deserialization errors
+	const size_t CAPACITY = JSON_ARRAY_SIZE(255);
+	DynamicJsonDocument doc(CAPACITY);
+	DeserializationError error = deserializeJson(doc, server.arg("plain"));
+	if (error)
+	{
+		String errorText(error.f_str());
+		server.send(400, FPSTR(RESPONSE_TEXT), "Deserialization error: " + errorText);
+		return;
+	}
+
+	// Get the json array and copy it to a standard C array
+	JsonArray array = doc.as<JsonArray>();
+	if (array.size() > 0xFF)
+	{
+		server.send(400, FPSTR(RESPONSE_TEXT), F("Too many bytes in one part!"));
+		return;
+	}
+
+	uint8_t buffer[array.size()];
+	copyArray(array, buffer, array.size());
+
+	// Copy the part to the given offset of the program image
+	long offset = server.arg("offset").toInt();
+	if (offset < 0 || offset > CpuController::MaxOverlaySize || !cpu.writeOverlay(offset, buffer, sizeof(buffer)))
+	{
+		server.send(400, FPSTR(RESPONSE_TEXT), F("Couldn't write overlay, invalid offset or segment is paging!"));
+		return;
+	}
+
+	getOverlay();
+}
+
+/* This starts overlay mode and loads the first segment into RAM. */
+void postOverlayLoad()
+{
+	// Check if the cpu is in load code mode
+	if (!cpu.getLoadCodeMode())
+	{
+		server.send(405, FPSTR(RESPONSE_TEXT), F("CPU is not in load code mode!"));
+		return;
+	}
+
+	if (jobs.isBusy())
+	{
+		server.send(409, FPSTR(RESPONSE_TEXT), F("CPU is busy with a job!"));
+		return;
+	}
+
+	long segmentSize = server.arg("segmentSize").toInt();
+	if (segmentSize <= 0 || segmentSize > 0xFF || !cpu.loadOverlayToRam(segmentSize))
+	{
+		server.send(400, FPSTR(RESPONSE_TEXT), F("Invalid segment size or no overlay received!"));
+		return;
+	}
+
+	getOverlay();
+}
+
+/* This stops overlay mode and releases the overlay buffer. */
+void deleteOverlay()
+{
+	cpu.clearOverlay();
+	getOverlay();
+}
+
+/* This returns the active microcode bank and all banks stored in flash. */
+void getMicrocode()
+{
+	String buf;
+	StaticJsonDocument<255> doc;
+
+	doc["activeBank"] = cpu.UCode.getActiveBank();
+	doc["pendingBank"] = cpu.getPendingBank();
+
+	JsonArray banks = doc.createNestedArray("banks");
+	for (uint8_t bank = 1; bank < CpuMicrocode::MaxBanks; bank++)
+	{
+		if (CpuMicrocode::bankExists(bank))
+			banks.add(bank);
+	}
+
+	serializeJson(doc, buf);
+
+	server.send(200, FPSTR(RESPONSE_JSON), buf);
+}
+
+/* This converts a json instruction definition into a microcode entry, the microcode is either one step list for all flags or one list per flag. */
+boolean parseMicrocodeEntry(JsonObject instruction, MicrocodeEntry &entry)
+{
+	JsonArray microcode = instruction["microcode"].as<JsonArray>();
+
+	long opcode = instruction["opcode"] | -1;
+	boolean perFlags = microcode[0].is<JsonArray>();
+
+	if (opcode < 0 || opcode > 0xFF || microcode.size() == 0 || (perFlags && microcode.size() != DefaultCpuModel::FlagStates))
+		return false;
+
+	entry.opcode = opcode;
+	entry.steps = perFlags ? microcode[0].size() : microcode.size();
+
+	if (entry.steps == 0 || entry.steps > CpuMicrocode::MaxCustomSteps)
+		return false;
+
+	for (uint8_t flags = 0; flags < DefaultCpuModel::FlagStates; flags++)
+	{
+		JsonArray steps = perFlags ? microcode[flags].as<JsonArray>() : microcode;
+		if (steps.size() != entry.steps)
+			return false;
+
+		copyArray(steps, entry.controlWords[flags], entry.steps);
+	}
+
+	return true;
+}
+
+/* This stores a microcode bank with custom instructions in flash. */
+void postMicrocode()
+{
+	if (!server.hasArg("bank"))
+	{
+		server.send(400, FPSTR(RESPONSE_TEXT), F("bank argument missing!"));
+		return;
+	}
+
+	long bank = server.arg("bank").toInt();
+	if (bank <= 0 || bank >= CpuMicrocode::MaxBanks)
+	{
+		server.send(400, FPSTR(RESPONSE_TEXT), F("Invalid bank, bank 0 is the built in microcode!"));
+		return;
+	}
+
+	//	Check if body was received
+	if (server.hasArg("plain") == false)
+	{
+		server.send(400, FPSTR(RESPONSE_TEXT), F("Body not received!"));
+		return;
+	}
+
+	// Deserialize body and check for deserialization errors, the keys of every instruction get copied from the body
+	const size_t CAPACITY = JSON_ARRAY_SIZE(CpuMicrocode::MaxBankEntries) +
+							CpuMicrocode::MaxBankEntries * (JSON_OBJECT_SIZE(2) + JSON_STRING_SIZE(sizeof("opcode") - 1) + JSON_STRING_SIZE(sizeof("microcode") - 1) +
+															JSON_ARRAY_SIZE(DefaultCpuModel::FlagStates) +
+															DefaultCpuModel::FlagStates * JSON_ARRAY_SIZE(CpuMicrocode::MaxCustomSteps));
+	DynamicJsonDocument doc(CAPACITY);
+	DeserializationError error = deserializeJson(doc, server.arg("plain"));
+	if (error)
+	{
+		String errorText(error.f_str());
+		server.send(400, FPSTR(RESPONSE_TEXT), "Deserialization error: " + errorText);
+		return;
+	}
+
+	JsonArray array = doc.as<JsonArray>();
+	if (array.size() > CpuMicrocode::MaxBankEntries)
+	{
+		server.send(400, FPSTR(RESPONSE_TEXT), F("Too many instructions in bank!"));
+		return;
+	}
+
+	// Convert each instruction into a microcode entry
+	MicrocodeEntry *entries = new MicrocodeEntry[array.size()]();
+	uint8_t count = 0;
+
+	for (JsonObject instruction : array)
+	{
+		if (!parseMicrocodeEntry(instruction, entries[count]))
+			break;
+
+		count++;
+	}
+
+	if (count != array.size())
+	{
+		delete[] entries;
+		server.send(400, FPSTR(RESPONSE_TEXT), String(F("Invalid microcode for instruction ")) + count);
+		return;
+	}
+
+	boolean saved = CpuMicrocode::saveBank(bank, entries, count);
+	delete[] entries;
+
+	if (!saved)
+	{
+		server.send(500, FPSTR(RESPONSE_TEXT), F("Couldn't store microcode bank!"));
+		return;
+	}
+
+	getMicrocode();
+}
+
+/* This switches the cpu controller to another microcode bank. */
+void postMicrocodeBank()
+{
+	if (!server.hasArg("bank"))
+	{
+		server.send(400, FPSTR(RESPONSE_TEXT), F("bank argument missing!"));
+		return;
+	}
+
+	if (jobs.isBusy())
+	{
+		server.send(409, FPSTR(RESPONSE_TEXT), F("CPU is busy with a job!"));
+		return;
+	}
+
+	long bank = server.arg("bank").toInt();
+	if (bank < 0 || bank >= CpuMicrocode::MaxBanks || !cpu.selectMicrocodeBank(bank))
+	{
+		server.send(404, FPSTR(RESPONSE_TEXT), F("Microcode bank not found!"));
+		return;
+	}
+
+	getMicrocode();
+}
+
+/* This removes a microcode bank from flash. */
+void deleteMicrocode()
+{
+	long bank = server.arg("bank").toInt();
+	if (bank <= 0 || bank >= CpuMicrocode::MaxBanks || !CpuMicrocode::removeBank(bank))
+	{
+		server.send(404, FPSTR(RESPONSE_TEXT), F("Microcode bank not found!"));
+		return;
+	}
+
+	getMicrocode();
+}
+
+/* This returns where the executed programs spent their clock cycles. */
+void getProfile()
+{
+	CpuProfiler &profile = cpu.Profile;
+
+	// Count the executed opcodes and hot spots first, the document is sized for them
+	uint16_t opcodeCount = 0;
+	for (uint16_t opcode = 0; opcode < 0x100; opcode++)
+	{
+		if (profile.getInstructions(opcode) > 0 || profile.getWastedSteps(opcode) > 0)
+			opcodeCount++;
+	}
+
+	uint8_t pcs[0x08];
+	uint8_t found = profile.getHotSpots(pcs, sizeof(pcs));
+
+	String buf;
+	DynamicJsonDocument doc(JSON_OBJECT_SIZE(9) + JSON_ARRAY_SIZE(0x04) +
+							JSON_ARRAY_SIZE(opcodeCount) + opcodeCount * JSON_OBJECT_SIZE(4) +
+							JSON_ARRAY_SIZE(found) + found * JSON_OBJECT_SIZE(2));
+
+	doc["cycles"] = profile.getTotalCycles();
+	doc["instructions"] = profile.getTotalInstructions();
+	doc["cpi"] = profile.getTotalInstructions() > 0 ? (float)profile.getTotalCycles() / profile.getTotalInstructions() : 0.0f;
+	doc["wastedSteps"] = profile.getTotalWastedSteps();
+	doc["jumps"] = profile.getJumps();
+	doc["pc"] = cpu.getEstimatedPc();
+
+	// Cycles in each flag state, indexed by the flags
+	JsonArray flags = doc.createNestedArray("flagCycles");
+	for (uint8_t i = 0; i < 0x04; i++)
+		flags.add(profile.getFlagCycles(i));
+
+	// Histogram of all executed instructions
+	JsonArray opcodes = doc.createNestedArray("opcodes");
+	for (uint16_t opcode = 0; opcode < 0x100; opcode++)
+	{
+		if (profile.getInstructions(opcode) == 0 && profile.getWastedSteps(opcode) == 0)
+			continue;
+
+		JsonObject entry = opcodes.createNestedObject();
+
+		entry["opcode"] = opcode;
+		entry["instructions"] = profile.getInstructions(opcode);
+		entry["cycles"] = profile.getCycles(opcode);
+		entry["wastedSteps"] = profile.getWastedSteps(opcode);
+	}
+
+	// Program counters with the most instruction fetches
+	JsonArray hotSpots = doc.createNestedArray("hotSpots");
+	for (uint8_t i = 0; i < found; i++)
+	{
+		JsonObject entry = hotSpots.createNestedObject();
+
+		entry["pc"] = pcs[i];
+		entry["fetches"] = profile.getPcCount(pcs[i]);
+	}
+
+	serializeJson(doc, buf);
+
+	server.send(200, FPSTR(RESPONSE_JSON), buf);
+}
+
+/* This clears all profiler counters. */
+void deleteProfile()
+{
+	cpu.Profile.reset();
+	getProfile();
+}
+
+/* This returns the registers and the recorded history of the virtual cpu. */
+void getEmulator()
+{
+	String buf;
+	DynamicJsonDocument doc(JSON_OBJECT_SIZE(8) + JSON_OBJECT_SIZE(9) + JSON_OBJECT_SIZE(4) + JSON_ARRAY_SIZE(DefaultCpuModel::RamSize));
+
+	CpuEmulator &emulator = cpu.Emulator;
+
+	doc["enabled"] = cpu.getVirtualCpu();
+	doc["paused"] = cpu.getVirtualPaused();
+	doc["halted"] = emulator.isHalted();
+	doc["breakpoint"] = emulator.getBreakpoint();
+	doc["cycle"] = emulator.getCycle();
+
+	JsonObject registers = doc.createNestedObject("registers");
+	registers["a"] = emulator.getRegister(REG_A);
+	registers["b"] = emulator.getRegister(REG_B);
+	registers["pc"] = emulator.getRegister(REG_PC);
+	registers["mar"] = emulator.getRegister(REG_MAR);
+	registers["ir"] = emulator.getRegister(REG_IR);
+	registers["iop"] = emulator.getRegister(REG_IOP);
+	registers["out"] = emulator.getRegister(REG_OUT);
+	registers["flags"] = emulator.getRegister(REG_FLAGS);
+	registers["step"] = emulator.getRegister(REG_STEP);
+
+	JsonObject history = doc.createNestedObject("history");
+	history["enabled"] = emulator.getHistory();
+	history["oldestCycle"] = emulator.getOldestCycle();
+	history["snapshots"] = emulator.getSnapshotCount();
+	history["deltaBytes"] = emulator.getDeltaBytes();
+
+	if (server.arg("ram") == "true")
+	{
+		JsonArray ram = doc.createNestedArray("ram");
+		for (uint16_t i = 0; i < DefaultCpuModel::RamSize; i++)
+			ram.add(emulator.getState().ram[i]);
+	}
+
+	if (doc.overflowed())
+	{
+		server.send(500, FPSTR(RESPONSE_TEXT), F("Emulator state doesn't fit into the response!"));
+		return;
+	}
+
+	serializeJson(doc, buf);
+
+	server.send(200, FPSTR(RESPONSE_JSON), buf);
+}
+
+/* This switches between the hardware and the virtual cpu and sets up its history. */
+void postEmulator()
+{
+	if (server.hasArg("enabled"))
+	{
+		if (jobs.isBusy())
+		{
+			server.send(409, FPSTR(RESPONSE_TEXT), F("CPU is busy with a job!"));
+			return;
+		}
+
+		cpu.setVirtualCpu(server.arg("enabled") == "true");
+	}
+
+	if (server.hasArg("history"))
+		cpu.Emulator.setHistory(server.arg("history") == "true");
+
+	if (server.hasArg("paused"))
+		cpu.setVirtualPaused(server.arg("paused") == "true");
+
+	getEmulator();
+}
+
+/* This steps the virtual cpu forward or back by the given number of clock cycles. */
+void postEmulatorStep()
+{
+	long count = server.hasArg("count") ? server.arg("count").toInt() : 1;
+	if (count < 1)
+	{
+		server.send(400, FPSTR(RESPONSE_TEXT), F("Invalid count!"));
+		return;
+	}
+
+	if (server.arg("reverse") == "true")
+	{
+		if (!cpu.reverseVirtualCpu(count, -1))
+		{
+			server.send(409, FPSTR(RESPONSE_TEXT), F("Virtual CPU isn't executing or has no history!"));
+			return;
+		}
+
+		getEmulator();
+		return;
+	}
+
+	// Keep the server responsive, longer runs have to be split up or use continue
+	if (!cpu.stepVirtualCpu(std::min<long>(count, 0x2710)))
+	{
+		server.send(409, FPSTR(RESPONSE_TEXT), F("Virtual CPU isn't executing!"));
+		return;
+	}
+
+	getEmulator();
+}
+
+/* This runs the virtual cpu forward or back to the next fetch from the breakpoint address. */
+void postEmulatorContinue()
+{
+	long breakpoint = server.hasArg("breakpoint") ? server.arg("breakpoint").toInt() : -1;
+	if (breakpoint < -1 || breakpoint > 0xFF)
+	{
+		server.send(400, FPSTR(RESPONSE_TEXT), F("Invalid breakpoint!"));
+		return;
+	}
+
+	if (server.arg("reverse") == "true")
+	{
+		if (breakpoint < 0)
+		{
+			server.send(400, FPSTR(RESPONSE_TEXT), F("breakpoint argument missing!"));
+			return;
+		}
+
+		if (!cpu.reverseVirtualCpu(0, breakpoint))
+		{
+			server.send(404, FPSTR(RESPONSE_TEXT), F("Breakpoint not found in the history!"));
+			return;
+		}
+
+		getEmulator();
+		return;
+	}
+
+	if (!cpu.continueVirtualCpu(breakpoint))
+	{
+		server.send(409, FPSTR(RESPONSE_TEXT), F("Virtual CPU isn't executing!"));
+		return;
+	}
+
+	getEmulator();
+}
+
 /* This resets the cpu controller. */
 void postReset()
 {
+	if (jobs.isBusy())
+	{
+		server.send(409, FPSTR(RESPONSE_TEXT), F("CPU is busy with a job!"));
+		return;
+	}
+
 	cpu.reset();
 	getInstruction();
 }
@@ -177,6 +858,13 @@ void getSettings()
 	doc["gw"] = WiFi.gatewayIP().toString();
 	doc["sm"] = WiFi.subnetMask().toString();
 
+	// The board revision the firmware was built for
+	JsonObject model = doc.createNestedObject("cpuModel");
+	model["ramSize"] = DefaultCpuModel::RamSize;
+	model["maxSteps"] = DefaultCpuModel::MaxSteps;
+	model["flagBits"] = DefaultCpuModel::FlagBits;
+	model["controlBytes"] = DefaultCpuModel::ControlBytes;
+
 	if (server.arg("signalStrength") == "true")
 	{
 		doc["signalStrengh"] = WiFi.RSSI();
@@ -218,6 +906,32 @@ void restServerRouting()
 	server.on(F("/instruction"), HTTP_GET, getInstruction);
 	server.on(F("/code"), HTTP_GET, getCodeLoadStatus);
 
+	server.on(F("/jobs"), HTTP_GET, getJobs);
+	server.on(F("/jobs"), HTTP_POST, postJobs);
+	server.on(F("/jobs"), HTTP_DELETE, deleteJobs);
+
+	server.on(F("/programs"), HTTP_GET, getPrograms);
+	server.on(F("/programs"), HTTP_POST, postPrograms);
+	server.on(F("/programs"), HTTP_DELETE, deletePrograms);
+
+	server.on(F("/profile"), HTTP_GET, getProfile);
+	server.on(F("/profile"), HTTP_DELETE, deleteProfile);
+
+	server.on(F("/emulator"), HTTP_GET, getEmulator);
+	server.on(F("/emulator"), HTTP_POST, postEmulator);
+	server.on(F("/emulator/step"), HTTP_POST, postEmulatorStep);
+	server.on(F("/emulator/continue"), HTTP_POST, postEmulatorContinue);
+
+	server.on(F("/overlay"), HTTP_GET, getOverlay);
+	server.on(F("/overlay"), HTTP_POST, postOverlay);
+	server.on(F("/overlay"), HTTP_DELETE, deleteOverlay);
+	server.on(F("/overlay/load"), HTTP_POST, postOverlayLoad);
+
+	server.on(F("/microcode"), HTTP_GET, getMicrocode);
+	server.on(F("/microcode"), HTTP_POST, postMicrocode);
+	server.on(F("/microcode"), HTTP_DELETE, deleteMicrocode);
+	server.on(F("/microcode/bank"), HTTP_POST, postMicrocodeBank);
+
 	server.on(F("/settings"), HTTP_GET, getSettings);
 
 	// Set not found response
@@ -242,43 +956,309 @@ void restServerRouting()
 					  });
 }
 
-/* Initializes the rest server. */
-void restServerInit()
+/* This writes the given value most significant byte first into the buffer. */
+void serialPutUint32(uint8_t buffer[], uint32_t value)
 {
-	// Activate mDNS this is used to be able to connect to the server
-	// with local DNS hostmane esp8266.local -> Doesn't work?!
-	if (MDNS.begin("esp8266"))
+	buffer[0] = value >> 24;
+	buffer[1] = value >> 16;
+	buffer[2] = value >> 8;
+	buffer[3] = value;
+}
+
+/* This returns the current mode of the cpu controller as serial mode. */
+uint8_t serialGetMode()
+{
+	if (cpu.getExecuteMode())
+		return SERIAL_MODE_EXECUTE;
+
+	if (cpu.getLoadCodeMode())
+		return SERIAL_MODE_LOAD_CODE;
+
+	return SERIAL_MODE_IDLE;
+}
+
+/* This sets the mode of the cpu controller from a serial frame. */
+void serialSetMode(uint8_t command, uint8_t payload[], uint8_t length)
+{
+	if (length != 1 || payload[0] > SERIAL_MODE_LOAD_CODE)
+	{
+		serialProtocol.sendError(command, SERIAL_ERR_INVALID_PAYLOAD);
+		return;
+	}
+
+	if (jobs.isBusy())
+	{
+		serialProtocol.sendError(command, SERIAL_ERR_BUSY);
+		return;
+	}
+
+	// Leave the current mode first, the cpu controller doesn't switch between executing and loading code directly
+	cpu.setExecuteMode(false);
+	cpu.setLoadCodeMode(false);
+
+	if (payload[0] == SERIAL_MODE_EXECUTE)
+		cpu.setExecuteMode(true);
+	else if (payload[0] == SERIAL_MODE_LOAD_CODE)
+		cpu.setLoadCodeMode(true);
+
+	uint8_t mode = serialGetMode();
+	serialProtocol.send(command | SERIAL_RESPONSE, &mode, 1);
+}
+
+/* This sets the code the cpu controller should load into RAM from a serial frame. */
+void serialLoadCode(uint8_t command, uint8_t payload[], uint8_t length)
+{
+	if (!cpu.getLoadCodeMode())
+	{
+		serialProtocol.sendError(command, SERIAL_ERR_WRONG_MODE);
+		return;
+	}
+
+	if (jobs.isBusy())
+	{
+		serialProtocol.sendError(command, SERIAL_ERR_BUSY);
+		return;
+	}
+
+	cpu.loadCodeToRam(payload, length);
+
+	// Keep the program in flash, so it can be loaded again by its hash
+	uint64_t hash;
+	if (!programs.store(payload, length, hash))
+	{
+		serialProtocol.sendError(command, SERIAL_ERR_STORAGE);
+		return;
+	}
+
+	uint8_t response[9] = {length};
+	serialPutUint32(response + 1, hash >> 32);
+	serialPutUint32(response + 5, hash);
+
+	serialProtocol.send(command | SERIAL_RESPONSE, response, sizeof(response));
+}
+
+/* This sends the current state of the cpu controller. */
+void serialGetState(uint8_t command)
+{
+	uint8_t response[13];
+
+	response[0] = cpu.getInstruction();
+	response[1] = cpu.getFlags();
+	response[2] = cpu.getInstructionStep();
+	response[3] = cpu.getControlWord() >> 8;
+	response[4] = cpu.getControlWord();
+	response[5] = cpu.getCodeLoaded();
+	response[6] = cpu.getCodeToLoad();
+	response[7] = cpu.isCodeLoaded();
+	response[8] = cpu.getEstimatedPc();
+	serialPutUint32(response + 9, cpu.getCycleCount());
+
+	serialProtocol.send(command | SERIAL_RESPONSE, response, sizeof(response));
+}
+
+/* This sends the most recently executed instruction steps, the oldest one first. */
+void serialGetTrace(uint8_t command)
+{
+	uint8_t response[CpuController::MaxTraceEntries * 5];
+
+	for (uint8_t i = 0; i < CpuController::MaxTraceEntries; i++)
+	{
+		const CpuTraceEntry &entry = cpu.getTraceEntry(i);
+
+		response[i * 5] = entry.instruction;
+		response[i * 5 + 1] = entry.flags;
+		response[i * 5 + 2] = entry.step;
+		response[i * 5 + 3] = entry.controlWord >> 8;
+		response[i * 5 + 4] = entry.controlWord;
+	}
+
+	serialProtocol.send(command | SERIAL_RESPONSE, response, sizeof(response));
+}
+
+/* This changes the baud rate of the serial port, after the response was sent with the old one. */
+void serialSetBaud(uint8_t command, uint8_t payload[], uint8_t length)
+{
+	uint32_t baud = length == 4 ? (uint32_t)payload[0] << 24 | (uint32_t)payload[1] << 16 | payload[2] << 8 | payload[3] : 0;
+
+	if (baud < SERIAL_MIN_BAUD || baud > SERIAL_MAX_BAUD)
+	{
+		serialProtocol.sendError(command, SERIAL_ERR_INVALID_PAYLOAD);
+		return;
+	}
+
+	serialProtocol.send(command | SERIAL_RESPONSE, payload, length);
+
+	Serial.flush();
+	Serial.updateBaudRate(baud);
+}
+
+/* This enables or disables the debug statements, they share the serial port with the frames. */
+void serialSetDebug(uint8_t command, uint8_t payload[], uint8_t length)
+{
+	if (length != 1)
+	{
+		serialProtocol.sendError(command, SERIAL_ERR_INVALID_PAYLOAD);
+		return;
+	}
+
+	cpu.setDebugOutput(payload[0]);
+	WiFiSetDebugOutput(payload[0]);
+	serialProtocol.send(command | SERIAL_RESPONSE, payload, length);
+}
+
+/* This handles all frames received by the serial protocol. */
+void handleSerialCommand(uint8_t command, uint8_t payload[], uint8_t length)
+{
+	// The debug statements would be mixed into the frames, so they stop with the first frame
+	cpu.setDebugOutput(false);
+	WiFiSetDebugOutput(false);
+
+	switch (command)
+	{
+	case SERIAL_CMD_PING:
+		serialProtocol.send(command | SERIAL_RESPONSE, payload, length);
+		break;
+
+	case SERIAL_CMD_GET_MODE:
+	{
+		uint8_t mode = serialGetMode();
+		serialProtocol.send(command | SERIAL_RESPONSE, &mode, 1);
+		break;
+	}
+
+	case SERIAL_CMD_SET_MODE:
+		serialSetMode(command, payload, length);
+		break;
+
+	case SERIAL_CMD_LOAD_CODE:
+		serialLoadCode(command, payload, length);
+		break;
+
+	case SERIAL_CMD_GET_STATE:
+		serialGetState(command);
+		break;
+
+	case SERIAL_CMD_GET_TRACE:
+		serialGetTrace(command);
+		break;
+
+	case SERIAL_CMD_RESET:
 	{
-		Serial.println(F("MDNS responder started!"));
+		cpu.reset();
+
+		uint8_t response[] = {cpu.getInstruction(), cpu.getFlags(), cpu.getInstructionStep()};
+		serialProtocol.send(command | SERIAL_RESPONSE, response, sizeof(response));
+		break;
 	}
 
+	case SERIAL_CMD_SET_BAUD:
+		serialSetBaud(command, payload, length);
+		break;
+
+	case SERIAL_CMD_SET_DEBUG:
+		serialSetDebug(command, payload, length);
+		break;
+
+	default:
+		serialProtocol.sendError(command, SERIAL_ERR_UNKNOWN_COMMAND);
+		break;
+	}
+}
+
+/* Initializes the rest server, it starts listening before a WiFi connection is established. */
+void restServerInit()
+{
 	// Set server routing
 	restServerRouting();
 
 	// Start server
 	server.begin();
 
-	Serial.println(F("HTTP Server started!"));
-	Serial.println();
+	if (cpu.getDebugOutput())
+	{
+		Serial.println(F("HTTP Server started!"));
+		Serial.println();
+	}
+}
+
+/* Initializes mDNS, once the WiFi connection is established. Reconnects keep the running responder. */
+void mdnsInit()
+{
+	static boolean mdnsStarted = false;
+	if (mdnsStarted)
+		return;
+
+	// Activate mDNS this is used to be able to connect to the server
+	// with local DNS hostmane esp8266.local -> Doesn't work?!
+	if (MDNS.begin("esp8266"))
+	{
+		mdnsStarted = true;
+
+		if (cpu.getDebugOutput())
+			Serial.println(F("MDNS responder started!"));
+	}
+}
+
+/* Loads the most recently used program into RAM, if enabled. */
+void autoloadProgram()
+{
+	programs.init();
+
+	if (!programs.getAutoload())
+		return;
+
+	uint8_t buffer[0xFF];
+	int size = programs.loadLast(buffer, sizeof(buffer));
+	if (size < 0)
+		return;
+
+	// The program gets loaded with the next clock pulses
+	cpu.setLoadCodeMode(true);
+	cpu.loadCodeToRam(buffer, size);
+
+	if (cpu.getDebugOutput())
+		Serial.println(F("Autoloading last program!"));
+}
+
+/* Mounts the file system and warm starts with the last program, this runs from the loop so the cpu controller is up right after boot. */
+void fileSystemInit()
+{
+	static boolean fileSystemMounted = false;
+	if (fileSystemMounted)
+		return;
+
+	fileSystemMounted = true;
+
+	// Mount the file system which holds the microcode banks and programs
+	if (!LittleFS.begin() && cpu.getDebugOutput())
+	{
+		Serial.println(F("Couldn't mount file system!"));
+	}
+
+	// Warm start with the last program
+	autoloadProgram();
 }
 
 /* Basic setup of the ESP8266. */
 void setup()
 {
-	Serial.begin(115200);
-	delay(2000);
-
-	// Initialize the cpu controller
+	// Initialize the cpu controller first, so it drives the shift registers right after boot
 	cpu.init();
 
+	// Room for a complete frame of the serial protocol
+	Serial.setRxBufferSize(0x200);
+	Serial.begin(SERIAL_BAUD);
+
+	serialProtocol.begin(handleSerialCommand);
+
 	// Set the wifi mode
 	WiFi.mode(WIFI_STA);
 
 	// Set a static ip and gateway
 	WiFi.config((IPAddress){192, 168, 2, 50}, (IPAddress){192, 168, 2, 1}, (IPAddress){255, 255, 255, 0}, (IPAddress){192, 168, 2, 1});
 
-	// Try to connect to a access point
-	WiFiConnect(WiFiAccessPoints, sizeof(WiFiAccessPoints));
+	// Start connecting to an access point in the background
+	WiFiConnectBegin(WiFiAccessPoints, sizeof(WiFiAccessPoints) / sizeof(WiFiAccessPoints[0]));
 
 	// Initialize the rest server
 	restServerInit();
@@ -287,6 +1267,15 @@ void setup()
 /* Main loop */
 void loop()
 {
-	server.handleClient();
 	cpu.handleInstructions();
+	jobs.handle();
+
+	// The file system gets mounted after setup, mounting it takes a while
+	fileSystemInit();
+
+	if (WiFiConnectHandle())
+		mdnsInit();
+
+	server.handleClient();
+	serialProtocol.handle();
 }
@@ -0,0 +1,243 @@
+/*
+ * Host stand-in for the parts of the ESP8266 Arduino core used by the firmware.
+ *
+ * Lets the controller, microcode and REST handlers compile and run on a PC,
+ * IO pins are kept in memory and can be driven through HostStubs.h.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <initializer_list>
+#include <string>
+
+using std::max;
+using std::min;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define IRAM_ATTR
+#define ICACHE_RAM_ATTR
+#define PROGMEM
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+#define FPSTR(pstr_pointer) (reinterpret_cast<const __FlashStringHelper *>(pstr_pointer))
+
+// ##############################################
+// IO pins, numbered like the NodeMCU board
+// ##############################################
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+
+#define LOW 0x0
+#define HIGH 0x1
+
+#define INPUT 0x00
+#define INPUT_PULLUP 0x02
+#define OUTPUT 0x01
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t value);
+
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t interrupt, void (*callback)(void), int mode);
+
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+unsigned long millis();
+unsigned long micros();
+
+/* Dynamic string with the interface of the Arduino String class. */
+class String
+{
+private:
+    std::string value;
+
+    static std::string fromNumber(unsigned long long number, bool negative, unsigned char base);
+
+public:
+    String() {}
+    String(const char *cstr) : value(cstr ? cstr : "") {}
+    String(const __FlashStringHelper *str) : value(str ? reinterpret_cast<const char *>(str) : "") {}
+    String(const std::string &str) : value(str) {}
+    explicit String(char c) : value(1, c) {}
+    explicit String(unsigned char number, unsigned char base = DEC) : value(fromNumber(number, false, base)) {}
+    explicit String(int number, unsigned char base = DEC) : value(fromNumber(number < 0 ? -(long long)number : number, number < 0, base)) {}
+    explicit String(unsigned int number, unsigned char base = DEC) : value(fromNumber(number, false, base)) {}
+    explicit String(long number, unsigned char base = DEC) : value(fromNumber(number < 0 ? -(long long)number : number, number < 0, base)) {}
+    explicit String(unsigned long number, unsigned char base = DEC) : value(fromNumber(number, false, base)) {}
+    explicit String(double number, unsigned char decimals = 2);
+
+    const char *c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.length(); }
+    bool reserve(unsigned int size) { value.reserve(size); return true; }
+
+    bool concat(const String &str) { value += str.value; return true; }
+    bool concat(const char *cstr) { value += cstr ? cstr : ""; return true; }
+    bool concat(const char *cstr, unsigned int length) { value.append(cstr, length); return true; }
+    bool concat(char c) { value += c; return true; }
+    bool concat(unsigned char number) { return concat(String(number)); }
+    bool concat(int number) { return concat(String(number)); }
+    bool concat(unsigned int number) { return concat(String(number)); }
+    bool concat(long number) { return concat(String(number)); }
+    bool concat(unsigned long number) { return concat(String(number)); }
+    bool concat(double number) { return concat(String(number)); }
+    bool concat(const __FlashStringHelper *str) { return concat(reinterpret_cast<const char *>(str)); }
+
+    template <typename T>
+    String &operator+=(const T &rhs)
+    {
+        concat(rhs);
+        return *this;
+    }
+
+    template <typename T>
+    friend String operator+(const String &lhs, const T &rhs)
+    {
+        String result(lhs);
+        result.concat(rhs);
+        return result;
+    }
+
+    friend String operator+(const char *lhs, const String &rhs)
+    {
+        String result(lhs);
+        result.concat(rhs);
+        return result;
+    }
+
+    bool operator==(const String &rhs) const { return value == rhs.value; }
+    bool operator==(const char *rhs) const { return value == (rhs ? rhs : ""); }
+    bool operator!=(const String &rhs) const { return value != rhs.value; }
+    bool operator!=(const char *rhs) const { return !(*this == rhs); }
+    bool operator<(const String &rhs) const { return value < rhs.value; }
+
+    char operator[](unsigned int index) const { return index < value.length() ? value[index] : 0; }
+    char charAt(unsigned int index) const { return (*this)[index]; }
+
+    int indexOf(char c, unsigned int from = 0) const;
+    int indexOf(const String &str, unsigned int from = 0) const;
+    String substring(unsigned int from) const { return substring(from, length()); }
+    String substring(unsigned int from, unsigned int to) const;
+    bool startsWith(const String &prefix) const { return value.compare(0, prefix.value.length(), prefix.value) == 0; }
+    bool isEmpty() const { return value.empty(); }
+
+    long toInt() const { return strtol(value.c_str(), nullptr, 10); }
+    double toFloat() const { return strtod(value.c_str(), nullptr); }
+};
+
+/* Result type of string concatenations in the Arduino core, some libraries refer to it. */
+class StringSumHelper : public String
+{
+public:
+    StringSumHelper(const String &str) : String(str) {}
+};
+
+class HardwareSerial;
+
+/* Interface of objects which can print themselves to the serial port. */
+class Printable
+{
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(HardwareSerial &serial) const = 0;
+};
+
+/* Serial port which discards all output, except for what the host reads back through HostStubs.h. */
+class HardwareSerial
+{
+private:
+    size_t print(const std::string &text);
+
+public:
+    void begin(unsigned long baud);
+    void end() {}
+    void updateBaudRate(unsigned long baud);
+    unsigned long baudRate() { return baud; }
+    size_t setRxBufferSize(size_t size) { return size; }
+
+    int available();
+    int read();
+    int peek();
+    size_t readBytes(uint8_t *buffer, size_t length);
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    int availableForWrite() { return 0x80; }
+    void flush() {}
+
+    size_t print(const char *text) { return print(std::string(text)); }
+    size_t print(const String &text) { return print(std::string(text.c_str())); }
+    size_t print(const __FlashStringHelper *text) { return print(reinterpret_cast<const char *>(text)); }
+    size_t print(char c) { return print(std::string(1, c)); }
+    size_t print(unsigned char number, int base = DEC) { return print(String(number, base)); }
+    size_t print(int number, int base = DEC) { return print(String(number, base)); }
+    size_t print(unsigned int number, int base = DEC) { return print(String(number, base)); }
+    size_t print(long number, int base = DEC) { return print(String(number, base)); }
+    size_t print(unsigned long number, int base = DEC) { return print(String(number, base)); }
+    size_t print(double number, int decimals = 2) { return print(String(number, decimals)); }
+    size_t print(const Printable &printable) { return printable.printTo(*this); }
+
+    size_t println() { return print("\r\n"); }
+
+    template <typename T>
+    size_t println(const T &value) { return print(value) + println(); }
+
+    template <typename T>
+    size_t println(const T &value, int format) { return print(value, format) + println(); }
+
+    unsigned long baud = 0;
+};
+
+extern HardwareSerial Serial;
+
+/* ESP8266 specific functions. */
+class EspClass
+{
+public:
+    uint32_t getChipId() { return 0x00E5B266; }
+    uint32_t getFlashChipId() { return 0x001640EF; }
+    uint32_t getFlashChipSize() { return 0x400000; }
+    uint32_t getFlashChipRealSize() { return 0x400000; }
+    uint32_t getFreeHeap() { return 0xA000; }
+    uint32_t getCycleCount() { return micros() * 80; }
+
+    bool rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size);
+    bool rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size);
+
+    void restart() {}
+};
+
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,78 @@
+#include "ESP8266WebServer.h"
+
+static const String emptyString;
+
+void ESP8266WebServer::on(const String &uri, HTTPMethod method, THandlerFunction handler)
+{
+    handlers.push_back({uri, method, handler});
+}
+
+void ESP8266WebServer::send(int code, const char *contentType, const String &content)
+{
+    responseCode = code;
+    responseType = contentType;
+    responseContent = content;
+}
+
+const String &ESP8266WebServer::arg(const String &name) const
+{
+    for (auto &argument : currentArgs)
+    {
+        if (argument.first == name)
+            return argument.second;
+    }
+
+    return emptyString;
+}
+
+const String &ESP8266WebServer::arg(int index) const
+{
+    return index < args() ? currentArgs[index].second : emptyString;
+}
+
+const String &ESP8266WebServer::argName(int index) const
+{
+    return index < args() ? currentArgs[index].first : emptyString;
+}
+
+bool ESP8266WebServer::hasArg(const String &name) const
+{
+    for (auto &argument : currentArgs)
+    {
+        if (argument.first == name)
+            return true;
+    }
+
+    return false;
+}
+
+int ESP8266WebServer::hostRequest(HTTPMethod method, const String &uri, const Arguments &args, const String &body)
+{
+    currentMethod = method;
+    currentUri = uri;
+    currentArgs = args;
+
+    // The request body is passed to the handlers as plain argument, like the original does
+    if (body.length() > 0)
+        currentArgs.push_back({String("plain"), body});
+
+    responseCode = 0;
+    responseType = String();
+    responseContent = String();
+
+    for (auto &handler : handlers)
+    {
+        if ((handler.method == HTTP_ANY || handler.method == method) && handler.uri == uri)
+        {
+            handler.function();
+            return responseCode;
+        }
+    }
+
+    if (notFoundHandler)
+        notFoundHandler();
+    else
+        send(404, "text/plain", String("Not found: ") + uri);
+
+    return responseCode;
+}
@@ -0,0 +1,89 @@
+/*
+ * Host stand-in for the ESP8266 web server.
+ *
+ * Routes requests the same way as the original, by a linear search over all
+ * registered handlers. Instead of reading from a socket, requests are passed
+ * in through hostRequest() and the response is kept for the caller.
+ */
+
+#ifndef HOST_ESP8266_WEB_SERVER_H
+#define HOST_ESP8266_WEB_SERVER_H
+
+#include <Arduino.h>
+
+#include <functional>
+#include <utility>
+#include <vector>
+
+enum HTTPMethod
+{
+    HTTP_ANY,
+    HTTP_GET,
+    HTTP_HEAD,
+    HTTP_POST,
+    HTTP_PUT,
+    HTTP_PATCH,
+    HTTP_DELETE,
+    HTTP_OPTIONS
+};
+
+/* Web server which gets its requests from the host. */
+class ESP8266WebServer
+{
+public:
+    typedef std::function<void(void)> THandlerFunction;
+    typedef std::vector<std::pair<String, String>> Arguments;
+
+private:
+    struct Handler
+    {
+        String uri;
+        HTTPMethod method;
+        THandlerFunction function;
+    };
+
+    std::vector<Handler> handlers;
+    THandlerFunction notFoundHandler;
+
+    HTTPMethod currentMethod = HTTP_ANY;
+    String currentUri;
+    Arguments currentArgs;
+
+    int responseCode = 0;
+    String responseType;
+    String responseContent;
+
+public:
+    ESP8266WebServer(int port = 80) { (void)port; }
+
+    void begin() {}
+    void close() {}
+    void handleClient() {}
+
+    void on(const String &uri, HTTPMethod method, THandlerFunction handler);
+    void onNotFound(THandlerFunction handler) { notFoundHandler = handler; }
+
+    void send(int code, const char *contentType, const String &content);
+    void send(int code, const __FlashStringHelper *contentType, const String &content) { send(code, reinterpret_cast<const char *>(contentType), content); }
+    void send(int code, const String &contentType, const String &content) { send(code, contentType.c_str(), content); }
+
+    const String &arg(const String &name) const;
+    const String &arg(int index) const;
+    const String &argName(int index) const;
+    int args() const { return currentArgs.size(); }
+    bool hasArg(const String &name) const;
+
+    const String &uri() const { return currentUri; }
+    HTTPMethod method() const { return currentMethod; }
+
+    /* Host only: dispatches a request to its handler and returns the response code. */
+    int hostRequest(HTTPMethod method, const String &uri, const Arguments &args = Arguments(), const String &body = String());
+
+    /* Host only: returns the content type of the last response. */
+    const String &hostResponseType() const { return responseType; }
+
+    /* Host only: returns the content of the last response. */
+    const String &hostResponseContent() const { return responseContent; }
+};
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * Host stand-in for the ESP8266 WiFi library, which is always connected.
+ */
+
+#ifndef HOST_ESP8266_WIFI_H
+#define HOST_ESP8266_WIFI_H
+
+#include <Arduino.h>
+
+/* IPv4 address. */
+class IPAddress : public Printable
+{
+private:
+    uint8_t octets[4]{0};
+
+public:
+    IPAddress() {}
+    IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth) : octets{first, second, third, fourth} {}
+
+    uint8_t operator[](int index) const { return octets[index]; }
+
+    String toString() const
+    {
+        return String(octets[0]) + '.' + String(octets[1]) + '.' + String(octets[2]) + '.' + String(octets[3]);
+    }
+
+    size_t printTo(HardwareSerial &serial) const override { return serial.print(toString()); }
+};
+
+typedef enum
+{
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_WRONG_PASSWORD = 6,
+    WL_DISCONNECTED = 7
+} wl_status_t;
+
+typedef enum
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} WiFiMode_t;
+
+/* WiFi station interface. */
+class ESP8266WiFiClass
+{
+private:
+    IPAddress ip{127, 0, 0, 1};
+    IPAddress gateway{127, 0, 0, 1};
+    IPAddress subnet{255, 0, 0, 0};
+
+    uint8_t bssid[6]{0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    int32_t wifiChannel = 1;
+    String ssid;
+
+public:
+    bool mode(WiFiMode_t mode) { (void)mode; return true; }
+    bool persistent(bool persistent) { (void)persistent; return true; }
+    bool setAutoReconnect(bool autoReconnect) { (void)autoReconnect; return true; }
+
+    bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns = IPAddress())
+    {
+        (void)dns;
+        this->ip = local;
+        this->gateway = gateway;
+        this->subnet = subnet;
+        return true;
+    }
+
+    wl_status_t begin(const char *ssid, const char *passphrase = nullptr, int32_t channel = 0, const uint8_t *bssid = nullptr, bool connect = true)
+    {
+        (void)passphrase;
+        (void)connect;
+        this->ssid = ssid;
+
+        if (channel > 0)
+            wifiChannel = channel;
+
+        if (bssid != nullptr)
+            memcpy(this->bssid, bssid, sizeof(this->bssid));
+
+        return WL_CONNECTED;
+    }
+
+    bool disconnect(bool wifiOff = false) { (void)wifiOff; return true; }
+    wl_status_t status() { return WL_CONNECTED; }
+
+    IPAddress localIP() { return ip; }
+    IPAddress gatewayIP() { return gateway; }
+    IPAddress subnetMask() { return subnet; }
+
+    String SSID() { return ssid; }
+    uint8_t *BSSID() { return bssid; }
+    int32_t channel() { return wifiChannel; }
+    int32_t RSSI() { return -50; }
+};
+
+extern ESP8266WiFiClass WiFi;
+
+#endif
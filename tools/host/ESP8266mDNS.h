@@ -0,0 +1,21 @@
+/*
+ * Host stand-in for the ESP8266 mDNS responder.
+ */
+
+#ifndef HOST_ESP8266_MDNS_H
+#define HOST_ESP8266_MDNS_H
+
+#include <Arduino.h>
+
+/* mDNS responder which never answers. */
+class MDNSResponder
+{
+public:
+    bool begin(const char *hostname) { (void)hostname; return true; }
+    bool begin(const String &hostname) { return begin(hostname.c_str()); }
+    void update() {}
+};
+
+extern MDNSResponder MDNS;
+
+#endif
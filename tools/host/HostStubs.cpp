@@ -0,0 +1,282 @@
+#include <chrono>
+#include <deque>
+#include <string>
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <ESP8266mDNS.h>
+#include <LittleFS.h>
+
+#include "HostStubs.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+ESP8266WiFiClass WiFi;
+MDNSResponder MDNS;
+FS LittleFS;
+
+// ##############################################
+// IO pins and interrupts
+// ##############################################
+static uint8_t pinLevels[0x20]{0};
+static void (*pinInterrupts[0x20])(void){nullptr};
+static int pinInterruptModes[0x20]{0};
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (mode == INPUT_PULLUP && pin < sizeof(pinLevels))
+        pinLevels[pin] = HIGH;
+}
+
+int digitalRead(uint8_t pin)
+{
+    return pin < sizeof(pinLevels) ? pinLevels[pin] : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin < sizeof(pinLevels))
+        pinLevels[pin] = value ? HIGH : LOW;
+}
+
+void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t value)
+{
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        uint8_t bit = bitOrder == LSBFIRST ? (value >> i) & 1 : (value >> (7 - i)) & 1;
+
+        digitalWrite(dataPin, bit);
+        digitalWrite(clockPin, HIGH);
+        digitalWrite(clockPin, LOW);
+    }
+}
+
+int digitalPinToInterrupt(uint8_t pin)
+{
+    return pin;
+}
+
+void attachInterrupt(uint8_t interrupt, void (*callback)(void), int mode)
+{
+    if (interrupt >= sizeof(pinLevels))
+        return;
+
+    pinInterrupts[interrupt] = callback;
+    pinInterruptModes[interrupt] = mode;
+}
+
+void hostSetPin(uint8_t pin, int value)
+{
+    if (pin >= sizeof(pinLevels))
+        return;
+
+    uint8_t previous = pinLevels[pin];
+    pinLevels[pin] = value ? HIGH : LOW;
+
+    if (previous == pinLevels[pin] || pinInterrupts[pin] == nullptr)
+        return;
+
+    int mode = pinInterruptModes[pin];
+    boolean rising = pinLevels[pin] == HIGH;
+
+    if (mode == CHANGE || (mode == RISING && rising) || (mode == FALLING && !rising))
+        pinInterrupts[pin]();
+}
+
+int hostGetPin(uint8_t pin)
+{
+    return digitalRead(pin);
+}
+
+void hostClockPulse(uint8_t pin)
+{
+    hostSetPin(pin, LOW);
+    hostSetPin(pin, HIGH);
+}
+
+// ##############################################
+// Timing
+// ##############################################
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+void delay(unsigned long ms)
+{
+    // Never sleep, the host build measures the handlers and not the waiting
+    (void)ms;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    (void)us;
+}
+
+void yield()
+{
+}
+
+unsigned long millis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+// ##############################################
+// String
+// ##############################################
+std::string String::fromNumber(unsigned long long number, bool negative, unsigned char base)
+{
+    if (base < 2 || base > 16)
+        base = DEC;
+
+    std::string digits;
+    do
+    {
+        digits.insert(digits.begin(), "0123456789abcdef"[number % base]);
+        number /= base;
+    } while (number > 0);
+
+    return negative ? "-" + digits : digits;
+}
+
+String::String(double number, unsigned char decimals)
+{
+    char buffer[0x40];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, number);
+    value = buffer;
+}
+
+int String::indexOf(char c, unsigned int from) const
+{
+    size_t index = value.find(c, from);
+    return index == std::string::npos ? -1 : (int)index;
+}
+
+int String::indexOf(const String &str, unsigned int from) const
+{
+    size_t index = value.find(str.value, from);
+    return index == std::string::npos ? -1 : (int)index;
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+    if (from > to)
+        std::swap(from, to);
+
+    if (from >= value.length())
+        return String();
+
+    return String(value.substr(from, to - from));
+}
+
+// ##############################################
+// Serial
+// ##############################################
+static std::deque<uint8_t> serialInput;
+static std::string serialOutput;
+static bool serialDiscard = true;
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    this->baud = baud;
+}
+
+void HardwareSerial::updateBaudRate(unsigned long baud)
+{
+    this->baud = baud;
+}
+
+int HardwareSerial::available()
+{
+    return serialInput.size();
+}
+
+int HardwareSerial::read()
+{
+    if (serialInput.empty())
+        return -1;
+
+    uint8_t c = serialInput.front();
+    serialInput.pop_front();
+
+    return c;
+}
+
+int HardwareSerial::peek()
+{
+    return serialInput.empty() ? -1 : serialInput.front();
+}
+
+size_t HardwareSerial::readBytes(uint8_t *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length && !serialInput.empty())
+        buffer[count++] = read();
+
+    return count;
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    if (!serialDiscard)
+        serialOutput += (char)c;
+
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    if (!serialDiscard)
+        serialOutput.append((const char *)buffer, size);
+
+    return size;
+}
+
+size_t HardwareSerial::print(const std::string &text)
+{
+    return write((const uint8_t *)text.data(), text.size());
+}
+
+void hostSerialInput(const uint8_t *buffer, size_t size)
+{
+    serialInput.insert(serialInput.end(), buffer, buffer + size);
+}
+
+std::string hostSerialOutput()
+{
+    std::string output;
+    output.swap(serialOutput);
+
+    return output;
+}
+
+void hostSerialDiscard(bool discard)
+{
+    serialDiscard = discard;
+}
+
+// ##############################################
+// ESP
+// ##############################################
+static uint32_t rtcUserMemory[0x80]{0};
+
+bool EspClass::rtcUserMemoryRead(uint32_t offset, uint32_t *data, size_t size)
+{
+    if (offset * 4 + size > sizeof(rtcUserMemory))
+        return false;
+
+    memcpy(data, rtcUserMemory + offset, size);
+    return true;
+}
+
+bool EspClass::rtcUserMemoryWrite(uint32_t offset, uint32_t *data, size_t size)
+{
+    if (offset * 4 + size > sizeof(rtcUserMemory))
+        return false;
+
+    memcpy(rtcUserMemory + offset, data, size);
+    return true;
+}
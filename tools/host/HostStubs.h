@@ -0,0 +1,30 @@
+/*
+ * Host only functions to drive the stand-ins of the ESP8266 libraries.
+ */
+
+#ifndef HOST_STUBS_H
+#define HOST_STUBS_H
+
+#include <Arduino.h>
+
+#include <string>
+
+/* Sets the level of an input pin and triggers an attached interrupt on a matching edge. */
+void hostSetPin(uint8_t pin, int value);
+
+/* Returns the level an output pin was last written to. */
+int hostGetPin(uint8_t pin);
+
+/* Generates a full clock cycle on the given pin, falling edge first. */
+void hostClockPulse(uint8_t pin);
+
+/* Appends bytes the firmware will read from the serial port. */
+void hostSerialInput(const uint8_t *buffer, size_t size);
+
+/* Returns and clears all bytes the firmware has written to the serial port. */
+std::string hostSerialOutput();
+
+/* Drops the serial output instead of buffering it, enabled by default. */
+void hostSerialDiscard(bool discard);
+
+#endif
@@ -0,0 +1,92 @@
+#include "LittleFS.h"
+
+size_t File::read(uint8_t *buffer, size_t size)
+{
+    if (!data || offset >= data->size())
+        return 0;
+
+    size = std::min(size, data->size() - offset);
+    memcpy(buffer, data->data() + offset, size);
+    offset += size;
+
+    return size;
+}
+
+int File::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+size_t File::write(const uint8_t *buffer, size_t size)
+{
+    if (!data || !writable)
+        return 0;
+
+    if (offset + size > data->size())
+        data->resize(offset + size);
+
+    memcpy(data->data() + offset, buffer, size);
+    offset += size;
+
+    return size;
+}
+
+bool File::seek(uint32_t position)
+{
+    if (!data || position > data->size())
+        return false;
+
+    offset = position;
+    return true;
+}
+
+String File::name() const
+{
+    size_t slash = path.rfind('/');
+    return String(slash == std::string::npos ? path : path.substr(slash + 1));
+}
+
+File FS::open(const char *path, const char *mode)
+{
+    std::string name(path);
+    auto file = files.find(name);
+
+    // Reading requires an existing file
+    if (mode[0] == 'r')
+        return file == files.end() ? File() : File(file->second, name, mode[1] == '+', false);
+
+    if (file == files.end() || mode[0] == 'w')
+        files[name] = std::make_shared<std::vector<uint8_t>>();
+
+    return File(files[name], name, true, mode[0] == 'a');
+}
+
+bool FS::rename(const char *pathFrom, const char *pathTo)
+{
+    auto file = files.find(pathFrom);
+    if (file == files.end() || files.count(pathTo) > 0)
+        return false;
+
+    files[pathTo] = file->second;
+    files.erase(file);
+
+    return true;
+}
+
+Dir FS::openDir(const char *path)
+{
+    // List all files directly inside the given directory
+    std::string prefix(path);
+    if (prefix.empty() || prefix.back() != '/')
+        prefix += '/';
+
+    std::vector<std::pair<std::string, size_t>> entries;
+    for (auto &file : files)
+    {
+        if (file.first.compare(0, prefix.size(), prefix) == 0 && file.first.find('/', prefix.size()) == std::string::npos)
+            entries.push_back({file.first.substr(prefix.size()), file.second->size()});
+    }
+
+    return Dir(entries);
+}
@@ -0,0 +1,96 @@
+/*
+ * Host stand-in for the LittleFS flash file system, all files are kept in memory.
+ */
+
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include <Arduino.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Open file of the in-memory file system. */
+class File
+{
+private:
+    std::shared_ptr<std::vector<uint8_t>> data;
+    std::string path;
+    size_t offset = 0;
+    bool writable = false;
+
+public:
+    File() {}
+    File(std::shared_ptr<std::vector<uint8_t>> data, const std::string &path, bool writable, bool append)
+        : data(data), path(path), offset(append ? data->size() : 0), writable(writable) {}
+
+    explicit operator bool() const { return data != nullptr; }
+
+    size_t read(uint8_t *buffer, size_t size);
+    int read();
+    size_t write(const uint8_t *buffer, size_t size);
+    size_t write(uint8_t c) { return write(&c, 1); }
+
+    bool seek(uint32_t position);
+    size_t position() const { return offset; }
+    size_t size() const { return data ? data->size() : 0; }
+    int available() const { return data ? data->size() - offset : 0; }
+
+    String name() const;
+    const char *fullName() const { return path.c_str(); }
+
+    void flush() {}
+    void close() { data = nullptr; }
+};
+
+/* Iterator over all files inside a directory. */
+class Dir
+{
+private:
+    std::vector<std::pair<std::string, size_t>> entries;
+    int index = -1;
+
+public:
+    Dir() {}
+    Dir(std::vector<std::pair<std::string, size_t>> entries) : entries(entries) {}
+
+    bool next() { return ++index < (int)entries.size(); }
+    String fileName() const { return String(entries[index].first); }
+    size_t fileSize() const { return entries[index].second; }
+};
+
+/* Flash file system. */
+class FS
+{
+private:
+    std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+
+public:
+    bool begin() { return true; }
+    void end() {}
+    bool format() { files.clear(); return true; }
+
+    File open(const char *path, const char *mode);
+    File open(const String &path, const char *mode) { return open(path.c_str(), mode); }
+
+    bool exists(const char *path) { return files.count(path) > 0; }
+    bool exists(const String &path) { return exists(path.c_str()); }
+
+    bool remove(const char *path) { return files.erase(path) > 0; }
+    bool remove(const String &path) { return remove(path.c_str()); }
+
+    bool rename(const char *pathFrom, const char *pathTo);
+    bool rename(const String &pathFrom, const String &pathTo) { return rename(pathFrom.c_str(), pathTo.c_str()); }
+
+    bool mkdir(const char *path) { (void)path; return true; }
+    bool mkdir(const String &path) { return mkdir(path.c_str()); }
+
+    Dir openDir(const char *path);
+    Dir openDir(const String &path) { return openDir(path.c_str()); }
+};
+
+extern FS LittleFS;
+
+#endif
@@ -0,0 +1,285 @@
+/*
+ * Load test for the REST API of the cpu controller.
+ *
+ * Builds the routing and handlers of main.cpp against the host stand-ins in
+ * tools/host and fires workloads of requests at them. Reports requests per
+ * second and the p50/p99 latency of every endpoint, so throughput regressions
+ * show up before flashing. Also measures the clock cycles per second of the
+ * virtual cpu with and without the time travel history.
+ *
+ * Run with: pio run -e loadtest -t exec
+ * or pass the number of requests per workload: .pio/build/loadtest/program 20000
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <ESP8266WebServer.h>
+
+#include <PinDefinitions.h>
+#include <CpuController.h>
+#include <ProgramCache.h>
+
+#include "HostStubs.h"
+
+extern ESP8266WebServer server;
+extern CpuController cpu;
+
+void setup();
+void loop();
+
+/* A single request of a workload. */
+struct Request
+{
+    const char *name;
+    HTTPMethod method;
+    const char *uri;
+    ESP8266WebServer::Arguments args;
+    String body;
+    int expectedCode = 200;
+};
+
+/* A mix of requests which is sent round robin, with cpu clock pulses in between. */
+struct Workload
+{
+    const char *name;
+    std::vector<Request> setup;
+    std::vector<Request> requests;
+    uint8_t clockPulses;
+};
+
+/* Latencies of all requests to one endpoint in nanoseconds. */
+struct Samples
+{
+    const char *name;
+    std::vector<double> latencies;
+};
+
+/* Returns the byte at the given address of the test program. */
+static uint8_t codeByte(uint8_t address)
+{
+    return (address * 37 + 11) & 0xFF;
+}
+
+/* Returns a json array with the given number of bytes as body for a code upload. */
+static String codeBody(uint8_t size)
+{
+    String body("[");
+    for (uint8_t i = 0; i < size; i++)
+    {
+        if (i > 0)
+            body += ',';
+
+        body += (int)codeByte(i);
+    }
+
+    return body + "]";
+}
+
+/* Returns the program cache hash of the test program with the given number of bytes. */
+static String codeHash(uint8_t size)
+{
+    uint8_t buffer[0xFF];
+    for (uint8_t i = 0; i < size; i++)
+        buffer[i] = codeByte(i);
+
+    return ProgramCache::hashToString(ProgramCache::hash(buffer, size));
+}
+
+/* Returns the value at the given percentile of the sorted latencies. */
+static double percentile(const std::vector<double> &sorted, double fraction)
+{
+    size_t index = std::min(sorted.size() - 1, (size_t)(sorted.size() * fraction));
+    return sorted[index];
+}
+
+/* Sends all requests of the workload and prints the statistics of each endpoint, returns the number of failed requests. */
+static uint32_t runWorkload(const Workload &workload, uint32_t count)
+{
+    for (auto &request : workload.setup)
+        server.hostRequest(request.method, request.uri, request.args, request.body);
+
+    std::vector<Samples> samples;
+    for (auto &request : workload.requests)
+    {
+        auto sample = std::find_if(samples.begin(), samples.end(), [&](const Samples &s) { return strcmp(s.name, request.name) == 0; });
+        if (sample == samples.end())
+            samples.push_back({request.name, {}});
+    }
+    samples.push_back({"loop()", {}});
+
+    uint32_t failed = 0;
+    uint32_t warmup = count / 10;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < warmup + count; i++)
+    {
+        if (i == warmup)
+            start = std::chrono::steady_clock::now();
+
+        const Request &request = workload.requests[i % workload.requests.size()];
+
+        auto requestStart = std::chrono::steady_clock::now();
+        int code = server.hostRequest(request.method, request.uri, request.args, request.body);
+        auto requestEnd = std::chrono::steady_clock::now();
+
+        // Let the controller handle the clock pulses, the main loop runs at least once per pulse
+        for (uint8_t pulse = 0; pulse < workload.clockPulses; pulse++)
+        {
+            hostClockPulse(CPU_CLOCK_PIN);
+            loop();
+        }
+
+        loop();
+        auto loopEnd = std::chrono::steady_clock::now();
+
+        if (code != request.expectedCode)
+            failed++;
+
+        if (i < warmup)
+            continue;
+
+        for (auto &sample : samples)
+        {
+            if (strcmp(sample.name, request.name) == 0)
+                sample.latencies.push_back(std::chrono::duration<double, std::nano>(requestEnd - requestStart).count());
+        }
+
+        samples.back().latencies.push_back(std::chrono::duration<double, std::nano>(loopEnd - requestEnd).count());
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("\n%s: %u requests, %.0f requests/s, %u failed\n", workload.name, count, count / seconds, failed);
+    printf("  %-24s %10s %12s %10s %10s\n", "endpoint", "count", "requests/s", "p50 us", "p99 us");
+
+    for (auto &sample : samples)
+    {
+        std::vector<double> &sorted = sample.latencies;
+        std::sort(sorted.begin(), sorted.end());
+
+        double total = 0;
+        for (double latency : sorted)
+            total += latency;
+
+        printf("  %-24s %10zu %12.0f %10.2f %10.2f\n", sample.name, sorted.size(), sorted.size() / (total / 1e9),
+               percentile(sorted, 0.50) / 1e3, percentile(sorted, 0.99) / 1e3);
+    }
+
+    return failed;
+}
+
+/* Runs a counting loop on the virtual cpu and returns the clock cycles per second of the main loop. */
+static double runEmulator(boolean history, uint32_t cycles)
+{
+    // LDB 0x21, LDA 0x20, ADD, STA 0x20, TAO, JMP 0x02
+    uint8_t program[0x22]{0x11, 0x21, 0x10, 0x20, 0x20, 0x12, 0x20, 0x32, 0x04, 0x02};
+    program[0x21] = 0x01;
+
+    String body("[");
+    for (uint8_t i = 0; i < sizeof(program); i++)
+        body += (i > 0 ? String(",") : String()) + String(program[i]);
+
+    body += "]";
+
+    server.hostRequest(HTTP_POST, "/control", {{"mode", "idle"}});
+    server.hostRequest(HTTP_POST, "/emulator", {{"enabled", "true"}, {"history", history ? "true" : "false"}, {"paused", "false"}});
+    server.hostRequest(HTTP_POST, "/control", {{"mode", "loadcode"}});
+    server.hostRequest(HTTP_POST, "/code", {}, body);
+
+    while (!cpu.isCodeLoaded())
+        loop();
+
+    server.hostRequest(HTTP_POST, "/control", {{"mode", "execute"}});
+
+    uint32_t start = cpu.Emulator.getCycle();
+    auto startTime = std::chrono::steady_clock::now();
+
+    while (cpu.Emulator.getCycle() - start < cycles)
+        loop();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    server.hostRequest(HTTP_POST, "/control", {{"mode", "idle"}});
+    server.hostRequest(HTTP_POST, "/emulator", {{"enabled", "false"}, {"history", "false"}});
+
+    return cycles / seconds;
+}
+
+/* Prints the speed of the virtual cpu and the overhead of recording its history. */
+static void runEmulatorBenchmark(uint32_t count)
+{
+    uint32_t cycles = count * 100;
+
+    // Warm up once, so both runs start with the same caches
+    runEmulator(false, cycles / 10);
+
+    double plain = runEmulator(false, cycles);
+    double recorded = runEmulator(true, cycles);
+
+    printf("\nvirtual cpu: %u cycles\n", cycles);
+    printf("  %-24s %14.0f cycles/s\n", "without history", plain);
+    printf("  %-24s %14.0f cycles/s\n", "with history", recorded);
+    printf("  %-24s %14.1f %%\n", "history overhead", (plain / recorded - 1) * 100);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000;
+    if (count == 0)
+        count = 1;
+
+    setup();
+
+    const Request idle{"POST /control", HTTP_POST, "/control", {{"mode", "idle"}}, String()};
+    const Request loadCode{"POST /control", HTTP_POST, "/control", {{"mode", "loadcode"}}, String()};
+    const Request execute{"POST /control", HTTP_POST, "/control", {{"mode", "execute"}}, String()};
+
+    const Request getMode{"GET /mode", HTTP_GET, "/mode", {}, String()};
+    const Request getInstruction{"GET /instruction", HTTP_GET, "/instruction", {}, String()};
+    const Request getControlWord{"GET /controlword", HTTP_GET, "/controlword", {}, String()};
+    const Request getCode{"GET /code", HTTP_GET, "/code", {}, String()};
+    const Request getSettings{"GET /settings", HTTP_GET, "/settings", {{"signalStrength", "true"}, {"chipInfo", "true"}, {"freeHeap", "true"}}, String()};
+    const Request getMicrocode{"GET /microcode", HTTP_GET, "/microcode", {}, String()};
+    const Request getOverlay{"GET /overlay", HTTP_GET, "/overlay", {}, String()};
+    const Request postCodeSmall{"POST /code (16 B)", HTTP_POST, "/code", {}, codeBody(16)};
+    const Request postCodeLarge{"POST /code (255 B)", HTTP_POST, "/code", {}, codeBody(0xFF)};
+    const Request postCodeCached{"POST /code?hash (255 B)", HTTP_POST, "/code", {{"hash", codeHash(0xFF)}}, String()};
+    const Request postJob{"POST /jobs", HTTP_POST, "/jobs", {}, "[{\"code\":[1,2,3,4],\"cycleBudget\":8}]"};
+    const Request getJobs{"GET /jobs", HTTP_GET, "/jobs", {}, String()};
+    const Request deleteJobs{"DELETE /jobs", HTTP_DELETE, "/jobs", {}, String()};
+    const Request getProfile{"GET /profile", HTTP_GET, "/profile", {}, String()};
+    const Request getPrograms{"GET /programs", HTTP_GET, "/programs", {}, String()};
+    const Request postReset{"POST /reset", HTTP_POST, "/reset", {}, String()};
+    const Request notFound{"GET /missing", HTTP_GET, "/missing", {}, String(), 404};
+
+    const std::vector<Workload> workloads = {
+        {"read /mode", {idle}, {getMode}, 0},
+        {"read /instruction", {idle}, {getInstruction}, 0},
+        {"read /controlword", {idle}, {getControlWord}, 0},
+        {"read /code", {idle}, {getCode}, 0},
+        {"read /settings", {idle}, {getSettings}, 0},
+        {"read /microcode", {idle}, {getMicrocode}, 0},
+        {"read /overlay", {idle}, {getOverlay}, 0},
+        {"read /programs", {idle}, {getPrograms}, 0},
+        {"not found", {idle}, {notFound}, 0},
+        {"write /code", {idle, loadCode}, {postCodeSmall, postCodeLarge}, 0},
+        {"write /code from cache", {idle, loadCode, postCodeLarge}, {postCodeCached}, 0},
+        {"mixed upload and polling", {idle, loadCode}, {postCodeSmall, getInstruction, getInstruction, getCode, getInstruction, getInstruction, getCode}, 2},
+        {"mixed execute and polling", {idle, execute}, {getInstruction, getControlWord, getInstruction, getMode, getInstruction, postReset}, 2},
+        {"mixed jobs and polling", {deleteJobs, idle}, {postJob, getJobs, getJobs, getJobs, getJobs}, 8},
+        {"mixed execute and profiling", {idle, execute}, {getProfile, getInstruction, getInstruction, getInstruction}, 4},
+    };
+
+    uint32_t failed = 0;
+    for (auto &workload : workloads)
+        failed += runWorkload(workload, count);
+
+    runEmulatorBenchmark(count);
+
+    return failed > 0 ? 1 : 0;
+}
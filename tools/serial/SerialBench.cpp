@@ -0,0 +1,221 @@
+/*
+ * Benchmark of the binary serial protocol against the WiFi REST API.
+ *
+ * Measures the round-trip latency of reading the cpu state and the upload
+ * throughput of programs over both links of a connected cpu controller.
+ *
+ * Run with: pio run -e serialbench
+ * and then: .pio/build/serialbench/program /dev/ttyUSB0 921600 192.168.2.50 [requests]
+ */
+
+#include <netdb.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+#include "SerialClient.h"
+
+/* Latencies of all requests of one measurement in microseconds. */
+struct Result
+{
+    std::string name;
+    std::vector<double> latencies;
+    size_t bytes = 0;
+    uint32_t failed = 0;
+};
+
+/* This sends a single HTTP request to the cpu controller and returns the status code or -1 on a connection error. */
+static int httpRequest(const char *host, const char *method, const char *uri, const std::string &body)
+{
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *address;
+    if (getaddrinfo(host, "80", &hints, &address) != 0)
+        return -1;
+
+    int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd < 0 || connect(fd, address->ai_addr, address->ai_addrlen) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+
+        freeaddrinfo(address);
+        return -1;
+    }
+
+    freeaddrinfo(address);
+
+    std::string request = std::string(method) + " " + uri + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n";
+    if (!body.empty())
+        request += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+
+    request += "\r\n" + body;
+
+    if (write(fd, request.data(), request.size()) != (ssize_t)request.size())
+    {
+        close(fd);
+        return -1;
+    }
+
+    // The server closes the connection after the response
+    std::string response;
+    char buffer[0x400];
+    ssize_t n;
+
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+        response.append(buffer, n);
+
+    close(fd);
+
+    int code;
+    return sscanf(response.c_str(), "HTTP/%*s %d", &code) == 1 ? code : -1;
+}
+
+/* This runs the given request the given number of times and records its latencies. */
+static Result measure(const std::string &name, uint32_t count, size_t bytes, std::function<bool()> request)
+{
+    Result result;
+    result.name = name;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool success = request();
+        auto end = std::chrono::steady_clock::now();
+
+        if (!success)
+        {
+            result.failed++;
+            continue;
+        }
+
+        result.latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        result.bytes += bytes;
+    }
+
+    return result;
+}
+
+/* Returns the value at the given percentile of the sorted latencies. */
+static double percentile(const std::vector<double> &sorted, double fraction)
+{
+    if (sorted.empty())
+        return 0;
+
+    size_t index = std::min(sorted.size() - 1, (size_t)(sorted.size() * fraction));
+    return sorted[index];
+}
+
+static void printResult(Result &result)
+{
+    std::sort(result.latencies.begin(), result.latencies.end());
+
+    double total = 0;
+    for (double latency : result.latencies)
+        total += latency;
+
+    double bytesPerSecond = total > 0 ? result.bytes / (total / 1e6) : 0;
+
+    printf("  %-28s %8zu %8u %12.0f %12.0f %12.0f\n", result.name.c_str(), result.latencies.size(), result.failed,
+           percentile(result.latencies, 0.50), percentile(result.latencies, 0.99), bytesPerSecond);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <serial device> [baud] [host] [requests]\n", argv[0]);
+        return 2;
+    }
+
+    const char *device = argv[1];
+    uint32_t baud = argc > 2 ? strtoul(argv[2], nullptr, 10) : SERIAL_BAUD;
+    const char *host = argc > 3 && argv[3][0] != 0 ? argv[3] : nullptr;
+    uint32_t count = argc > 4 ? strtoul(argv[4], nullptr, 10) : 200;
+
+    if (count == 0)
+        count = 1;
+
+    SerialClient client;
+    if (!client.open(device) || !client.connect())
+    {
+        fprintf(stderr, "Couldn't connect: %s\n", client.getError().c_str());
+        return 1;
+    }
+
+    if (baud != SERIAL_BAUD && !client.setBaud(baud))
+    {
+        fprintf(stderr, "Couldn't switch to %u baud: %s\n", baud, client.getError().c_str());
+        return 1;
+    }
+
+    // The largest program which fits into RAM
+    uint8_t code[0xFF];
+    for (uint16_t i = 0; i < sizeof(code); i++)
+        code[i] = (i * 37 + 11) & 0xFF;
+
+    std::string codeBody = "[";
+    for (uint16_t i = 0; i < sizeof(code); i++)
+        codeBody += (i > 0 ? "," : "") + std::to_string(code[i]);
+
+    codeBody += "]";
+
+    std::vector<Result> results;
+
+    client.setMode(SERIAL_MODE_IDLE);
+
+    SerialCpuState state;
+    std::vector<SerialTraceEntry> trace;
+    const uint8_t ping[] = {0x00};
+
+    results.push_back(measure("serial ping", count, 0, [&]() { return client.ping(ping, sizeof(ping)); }));
+    results.push_back(measure("serial get state", count, 0, [&]() { return client.getState(state); }));
+    results.push_back(measure("serial get trace", count, 0, [&]() { return client.getTrace(trace); }));
+
+    client.setMode(SERIAL_MODE_LOAD_CODE);
+    results.push_back(measure("serial load code (255 B)", count, sizeof(code), [&]() { return client.loadCode(code, sizeof(code)); }));
+
+    // Switch straight from loading code to executing it and back, a failed mode switch counts as failed request
+    const uint8_t halt[] = {0x01};
+    results.push_back(measure("serial load and execute", count, sizeof(halt), [&]() {
+        return client.setMode(SERIAL_MODE_LOAD_CODE) && client.loadCode(halt, sizeof(halt)) && client.setMode(SERIAL_MODE_EXECUTE);
+    }));
+    client.setMode(SERIAL_MODE_IDLE);
+
+    if (host != nullptr)
+    {
+        httpRequest(host, "POST", "/control?mode=idle", "");
+        results.push_back(measure("rest GET /instruction", count, 0, [&]() { return httpRequest(host, "GET", "/instruction", "") == 200; }));
+        results.push_back(measure("rest GET /code", count, 0, [&]() { return httpRequest(host, "GET", "/code", "") == 200; }));
+
+        httpRequest(host, "POST", "/control?mode=loadcode", "");
+        results.push_back(measure("rest POST /code (255 B)", count, sizeof(code), [&]() { return httpRequest(host, "POST", "/code", codeBody) == 200; }));
+        httpRequest(host, "POST", "/control?mode=idle", "");
+    }
+
+    printf("%u requests each, serial at %u baud\n", count, baud);
+    printf("  %-28s %8s %8s %12s %12s %12s\n", "request", "count", "failed", "p50 us", "p99 us", "bytes/s");
+
+    uint32_t failed = 0;
+    for (auto &result : results)
+    {
+        printResult(result);
+        failed += result.failed;
+    }
+
+    // Leave the cpu controller at the default baud rate for the serial monitor
+    if (baud != SERIAL_BAUD)
+        client.setBaud(SERIAL_BAUD);
+
+    return failed > 0 ? 1 : 0;
+}
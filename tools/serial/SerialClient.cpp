@@ -0,0 +1,349 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "SerialClient.h"
+
+/* Returns the termios speed of the given baud rate or zero if it isn't supported. */
+static speed_t baudToSpeed(uint32_t baud)
+{
+    switch (baud)
+    {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+#ifdef B460800
+    case 460800: return B460800;
+#endif
+#ifdef B921600
+    case 921600: return B921600;
+#endif
+#ifdef B1500000
+    case 1500000: return B1500000;
+#endif
+#ifdef B2000000
+    case 2000000: return B2000000;
+#endif
+#ifdef B3000000
+    case 3000000: return B3000000;
+#endif
+    default: return 0;
+    }
+}
+
+bool SerialClient::open(const char *device, uint32_t baud)
+{
+    close();
+
+    fd = ::open(device, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        error = std::string("Couldn't open ") + device + ": " + strerror(errno);
+        return false;
+    }
+
+    struct termios tty;
+    if (tcgetattr(fd, &tty) != 0)
+    {
+        error = std::string("Couldn't read the settings of ") + device + ": " + strerror(errno);
+        close();
+        return false;
+    }
+
+    // Raw 8N1 without flow control
+    cfmakeraw(&tty);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+
+    if (tcsetattr(fd, TCSANOW, &tty) != 0 || !setSpeed(baud))
+    {
+        if (error.empty())
+            error = std::string("Couldn't configure ") + device + ": " + strerror(errno);
+
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void SerialClient::close()
+{
+    if (fd >= 0)
+        ::close(fd);
+
+    fd = -1;
+    pending.clear();
+}
+
+bool SerialClient::setSpeed(uint32_t baud)
+{
+    speed_t speed = baudToSpeed(baud);
+    if (speed == 0)
+    {
+        error = "Unsupported baud rate " + std::to_string(baud);
+        return false;
+    }
+
+    struct termios tty;
+    if (tcgetattr(fd, &tty) != 0 || cfsetispeed(&tty, speed) != 0 || cfsetospeed(&tty, speed) != 0 || tcsetattr(fd, TCSADRAIN, &tty) != 0)
+    {
+        error = std::string("Couldn't set the baud rate: ") + strerror(errno);
+        return false;
+    }
+
+    return true;
+}
+
+bool SerialClient::connect(uint32_t wait)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait);
+
+    // Drop the boot messages and debug statements which were received so far
+    tcflush(fd, TCIFLUSH);
+
+    do
+    {
+        const uint8_t payload[] = {'8', 'B', 'i', 't'};
+        if (ping(payload, sizeof(payload)))
+            return true;
+    } while (std::chrono::steady_clock::now() < end);
+
+    return false;
+}
+
+bool SerialClient::readBytes(uint8_t buffer[], size_t size, size_t *received)
+{
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+    // Bytes which were already read come first
+    size_t count = std::min(size, pending.size());
+    std::copy(pending.begin(), pending.begin() + count, buffer);
+    pending.erase(pending.begin(), pending.begin() + count);
+
+    if (received != nullptr)
+        *received = count;
+
+    while (count < size)
+    {
+        int remaining = std::chrono::duration_cast<std::chrono::milliseconds>(end - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0)
+            return false;
+
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, remaining) <= 0)
+            continue;
+
+        ssize_t n = ::read(fd, buffer + count, size - count);
+        if (n < 0 && errno != EAGAIN && errno != EINTR)
+            return false;
+
+        if (n > 0)
+        {
+            count += n;
+
+            if (received != nullptr)
+                *received = count;
+        }
+    }
+
+    return true;
+}
+
+bool SerialClient::readFrame(uint8_t &command, std::vector<uint8_t> &payload)
+{
+    uint8_t c;
+
+    while (true)
+    {
+        // Skip everything up to the next sync byte, like debug statements
+        do
+        {
+            if (!readBytes(&c, 1))
+            {
+                error = "Timeout";
+                return false;
+            }
+        } while (c != SERIAL_SYNC);
+
+        uint8_t frame[SERIAL_MAX_PAYLOAD + SERIAL_FRAME_OVERHEAD];
+        size_t header = 0;
+        size_t body = 0;
+
+        bool complete = readBytes(frame, 2, &header) && readBytes(frame + 2, frame[1] + 2, &body);
+        uint8_t length = frame[1];
+
+        // A sync byte inside of the text output, search the bytes after it for the next one
+        if (!complete || ((frame[length + 2] << 8) | frame[length + 3]) != serialCrc16(frame, length + 2))
+        {
+            pending.insert(pending.begin(), frame, frame + header + body);
+            continue;
+        }
+
+        command = frame[0];
+        payload.assign(frame + 2, frame + 2 + length);
+
+        return true;
+    }
+}
+
+bool SerialClient::request(uint8_t command, const uint8_t payload[], uint8_t length, std::vector<uint8_t> &response)
+{
+    error.clear();
+
+    if (fd < 0)
+    {
+        error = "Not connected";
+        return false;
+    }
+
+    uint8_t frame[SERIAL_MAX_PAYLOAD + SERIAL_FRAME_OVERHEAD] = {SERIAL_SYNC, command, length};
+    memcpy(frame + 3, payload, length);
+
+    uint16_t crc = serialCrc16(frame + 1, length + 2);
+    frame[length + 3] = crc >> 8;
+    frame[length + 4] = crc & 0xFF;
+
+    size_t size = length + SERIAL_FRAME_OVERHEAD;
+    if (::write(fd, frame, size) != (ssize_t)size)
+    {
+        error = std::string("Couldn't write: ") + strerror(errno);
+        return false;
+    }
+
+    uint8_t responseCommand;
+    do
+    {
+        if (!readFrame(responseCommand, response))
+            return false;
+
+        if (responseCommand == SERIAL_ERROR && response.size() == 2 && response[0] == command)
+        {
+            error = "Error response " + std::to_string(response[1]);
+            return false;
+        }
+
+        // Skip late responses of requests which timed out before
+    } while (responseCommand != (command | SERIAL_RESPONSE));
+
+    return true;
+}
+
+bool SerialClient::ping(const uint8_t payload[], uint8_t length)
+{
+    std::vector<uint8_t> response;
+    return request(SERIAL_CMD_PING, payload, length, response) && response.size() == length && memcmp(response.data(), payload, length) == 0;
+}
+
+bool SerialClient::getMode(uint8_t &mode)
+{
+    std::vector<uint8_t> response;
+    if (!request(SERIAL_CMD_GET_MODE, nullptr, 0, response) || response.size() != 1)
+        return false;
+
+    mode = response[0];
+    return true;
+}
+
+bool SerialClient::setMode(uint8_t mode)
+{
+    std::vector<uint8_t> response;
+    return request(SERIAL_CMD_SET_MODE, &mode, 1, response) && response.size() == 1 && response[0] == mode;
+}
+
+bool SerialClient::loadCode(const uint8_t code[], uint8_t size, uint64_t *hash)
+{
+    std::vector<uint8_t> response;
+    if (!request(SERIAL_CMD_LOAD_CODE, code, size, response) || response.size() != 9 || response[0] != size)
+        return false;
+
+    if (hash != nullptr)
+    {
+        *hash = 0;
+        for (uint8_t i = 1; i < 9; i++)
+            *hash = *hash << 8 | response[i];
+    }
+
+    return true;
+}
+
+bool SerialClient::getState(SerialCpuState &state)
+{
+    std::vector<uint8_t> response;
+    if (!request(SERIAL_CMD_GET_STATE, nullptr, 0, response) || response.size() != 13)
+        return false;
+
+    state.instruction = response[0];
+    state.flags = response[1];
+    state.step = response[2];
+    state.controlWord = response[3] << 8 | response[4];
+    state.codeLoaded = response[5];
+    state.codeSize = response[6];
+    state.loaded = response[7];
+    state.pc = response[8];
+    state.cycles = (uint32_t)response[9] << 24 | (uint32_t)response[10] << 16 | response[11] << 8 | response[12];
+
+    return true;
+}
+
+bool SerialClient::getTrace(std::vector<SerialTraceEntry> &trace)
+{
+    std::vector<uint8_t> response;
+    if (!request(SERIAL_CMD_GET_TRACE, nullptr, 0, response) || response.size() % 5 != 0)
+        return false;
+
+    trace.clear();
+    for (size_t i = 0; i < response.size(); i += 5)
+        trace.push_back({response[i], response[i + 1], response[i + 2], (uint16_t)(response[i + 3] << 8 | response[i + 4])});
+
+    return true;
+}
+
+bool SerialClient::reset()
+{
+    std::vector<uint8_t> response;
+    return request(SERIAL_CMD_RESET, nullptr, 0, response);
+}
+
+bool SerialClient::setBaud(uint32_t baud)
+{
+    if (baudToSpeed(baud) == 0)
+    {
+        error = "Unsupported baud rate " + std::to_string(baud);
+        return false;
+    }
+
+    uint8_t payload[] = {(uint8_t)(baud >> 24), (uint8_t)(baud >> 16), (uint8_t)(baud >> 8), (uint8_t)baud};
+
+    std::vector<uint8_t> response;
+    if (!request(SERIAL_CMD_SET_BAUD, payload, sizeof(payload), response))
+        return false;
+
+    // The cpu controller switches once the response is sent, give it a moment before the next frame
+    if (!setSpeed(baud))
+        return false;
+
+    usleep(10000);
+    tcflush(fd, TCIFLUSH);
+
+    return true;
+}
+
+bool SerialClient::setDebug(bool enabled)
+{
+    uint8_t payload = enabled;
+
+    std::vector<uint8_t> response;
+    return request(SERIAL_CMD_SET_DEBUG, &payload, 1, response);
+}
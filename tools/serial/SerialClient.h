@@ -0,0 +1,113 @@
+/*
+ * Host client of the binary serial protocol of the cpu controller.
+ *
+ * Talks to the ESP8266 over a POSIX serial device, see src/SerialDefinitions.h
+ * for the frame layout and the commands.
+ */
+
+#ifndef SERIAL_CLIENT_H
+#define SERIAL_CLIENT_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <SerialDefinitions.h>
+
+/* The state of the cpu controller as returned by the get state command. */
+struct SerialCpuState
+{
+    uint8_t instruction;
+    uint8_t flags;
+    uint8_t step;
+    uint16_t controlWord;
+    uint8_t codeLoaded;
+    uint8_t codeSize;
+    bool loaded;
+    uint8_t pc;
+    uint32_t cycles;
+};
+
+/* A single executed instruction step as returned by the get trace command. */
+struct SerialTraceEntry
+{
+    uint8_t instruction;
+    uint8_t flags;
+    uint8_t step;
+    uint16_t controlWord;
+};
+
+/* Class which sends commands to the cpu controller and waits for their responses. */
+class SerialClient
+{
+private:
+
+    int fd = -1;
+    uint32_t timeout = 500;
+
+    std::string error;
+
+    /* Bytes read after a false sync byte, they are searched for the next frame before reading from the device. */
+    std::vector<uint8_t> pending;
+
+    /* This reads exactly the given number of bytes, returns false on a timeout. The number of bytes read is returned in received. */
+    bool readBytes(uint8_t buffer[], size_t size, size_t *received = nullptr);
+
+    /* This reads the next frame with a valid CRC. */
+    bool readFrame(uint8_t &command, std::vector<uint8_t> &payload);
+
+    /* This sets the speed of the serial device. */
+    bool setSpeed(uint32_t baud);
+
+public:
+
+    ~SerialClient() { close(); }
+
+    /* This opens the serial device with the given baud rate. */
+    bool open(const char *device, uint32_t baud = SERIAL_BAUD);
+
+    /* This closes the serial device. */
+    void close();
+
+    /* This pings the cpu controller until it answers, it might still boot after opening the device. */
+    bool connect(uint32_t wait = 3000);
+
+    /* Sets the time in milliseconds to wait for a response. */
+    void setTimeout(uint32_t milliseconds) { timeout = milliseconds; }
+
+    /* Returns the reason the last command failed. */
+    const std::string &getError() { return error; }
+
+    /* This sends a command and waits for its response, error responses are returned as failure. */
+    bool request(uint8_t command, const uint8_t payload[], uint8_t length, std::vector<uint8_t> &response);
+
+    /* This sends the payload and checks that it is echoed back. */
+    bool ping(const uint8_t payload[], uint8_t length);
+
+    /* Returns the mode of the cpu controller, one of the SERIAL_MODE constants. */
+    bool getMode(uint8_t &mode);
+
+    /* Sets the mode of the cpu controller, one of the SERIAL_MODE constants. */
+    bool setMode(uint8_t mode);
+
+    /* Uploads code which the cpu controller loads into RAM, it has to be in load code mode. */
+    bool loadCode(const uint8_t code[], uint8_t size, uint64_t *hash = nullptr);
+
+    /* Returns the state of the cpu controller. */
+    bool getState(SerialCpuState &state);
+
+    /* Returns the most recently executed instruction steps, the oldest one first. */
+    bool getTrace(std::vector<SerialTraceEntry> &trace);
+
+    /* Resets the cpu controller. */
+    bool reset();
+
+    /* Switches the cpu controller and the serial device to the given baud rate. */
+    bool setBaud(uint32_t baud);
+
+    /* Enables or disables the debug statements of the cpu controller. */
+    bool setDebug(bool enabled);
+};
+
+#endif
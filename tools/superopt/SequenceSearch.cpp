@@ -0,0 +1,582 @@
+#include "SequenceSearch.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+#include <thread>
+
+// The instructions a program can consist of, all other opcodes are treated as unknown
+static const struct
+{
+    uint8_t opcode;
+    const char *name;
+} MNEMONICS[] = {
+    {NOP, "NOP"}, {HLT, "HLT"}, {PAG, "PAG"},
+    {JMP, "JMP"}, {JMC, "JMC"}, {JMZ, "JMZ"}, {JNZ, "JNZ"},
+    {LDA, "LDA"}, {LDB, "LDB"}, {STA, "STA"}, {STB, "STB"}, {STE, "STE"},
+    {ADD, "ADD"}, {SUB, "SUB"},
+    {TAB, "TAB"}, {TBA, "TBA"}, {TAO, "TAO"}, {TBO, "TBO"},
+};
+
+// The steps of the fetch, they are the same for every instruction
+static const uint8_t FETCH_STEPS = 0x02;
+
+/* Returns the next value of a splitmix64 generator, so every input can be generated from its index. */
+static uint64_t splitMix(uint64_t &state)
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+
+    return z ^ (z >> 31);
+}
+
+SequenceSearch::SequenceSearch(CpuMicrocode &microcode, uint8_t maxLength, uint8_t threads)
+    : microcode(microcode), maxLength(std::min(maxLength, MaxLength)), threads(std::max(threads, (uint8_t)1))
+{
+    analyzeMicrocode();
+}
+
+void SequenceSearch::analyzeMicrocode()
+{
+    memset(infos, 0, sizeof(infos));
+
+    for (auto &mnemonic : MNEMONICS)
+    {
+        InstructionInfo &info = infos[mnemonic.opcode];
+        info.name = mnemonic.name;
+        info.cycles = microcode.getInstructionSteps(mnemonic.opcode);
+
+        // Follow the steps after the fetch, registers count as read if they drive the bus before they get loaded
+        for (uint8_t step = FETCH_STEPS; step < info.cycles; step++)
+        {
+            CpuMicrocode::ControlWord base = microcode.getControlWord(mnemonic.opcode, 0, step);
+
+            if (base & C_CE)
+                info.operandBytes++;
+
+            for (uint8_t flags = 0; flags < DefaultCpuModel::FlagStates; flags++)
+            {
+                CpuMicrocode::ControlWord controlWord = microcode.getControlWord(mnemonic.opcode, flags, step);
+                uint16_t bus = controlWord & C_EPO;
+
+                if (controlWord != base)
+                    info.conditional = true;
+
+                if (bus == C_AO || bus == C_EO)
+                    info.reads |= USES_A & ~info.writes;
+
+                if (bus == C_BO || bus == C_EO)
+                    info.reads |= USES_B & ~info.writes;
+
+                if (controlWord & C_AI) info.writes |= USES_A;
+                if (controlWord & C_BI) info.writes |= USES_B;
+                if (controlWord & C_FI) info.writes |= USES_FLAGS;
+
+                if (controlWord & C_JMP) info.jumps = true;
+                if (controlWord & C_HLT) info.halts = true;
+                if (controlWord & C_OI) info.outputs = true;
+                if (controlWord & C_RI) info.memoryWrite = true;
+
+                // The operand gets loaded into the memory address register
+                if (bus == C_RO && (controlWord & C_MI))
+                    info.memoryOperand = true;
+            }
+        }
+
+        if (info.conditional)
+            info.reads |= USES_FLAGS;
+
+        // Paging replaces the RAM behind the program, so it ends a block like a jump
+        info.straightLine = !info.jumps && !info.halts && !info.conditional && mnemonic.opcode != PAG;
+    }
+}
+
+void SequenceSearch::getCost(const std::vector<uint8_t> &code, uint32_t &cycles, uint32_t &bytes)
+{
+    cycles = 0;
+    bytes = 0;
+
+    for (size_t address = 0; address < code.size(); address += 1 + infos[code[address]].operandBytes)
+    {
+        cycles += infos[code[address]].cycles;
+        bytes += 1 + infos[code[address]].operandBytes;
+    }
+}
+
+std::string SequenceSearch::disassemble(const std::vector<uint8_t> &code, uint8_t address)
+{
+    const InstructionInfo &info = infos[code[address]];
+
+    char text[0x20];
+    if (info.name == nullptr)
+        snprintf(text, sizeof(text), "0x%02X", code[address]);
+    else if (info.operandBytes > 0 && address + 1u < code.size())
+        snprintf(text, sizeof(text), "%s 0x%02X", info.name, code[address + 1]);
+    else
+        snprintf(text, sizeof(text), "%s", info.name);
+
+    return text;
+}
+
+CpuMicrocode::ControlWord SequenceSearch::clock(CpuEmulator &emulator, uint8_t &instruction, uint8_t &step)
+{
+    // Reset the step after the last step of the instruction, before the next one is read
+    if (step >= microcode.getInstructionSteps(instruction))
+        step = 0;
+
+    uint8_t buffer[2];
+    emulator.read(buffer, sizeof(buffer));
+
+    instruction = buffer[0];
+
+    CpuMicrocode::ControlWord controlWord = microcode.getControlWord(instruction, buffer[1], step);
+
+    emulator.latch(controlWord, 0x00);
+    emulator.clock(++step);
+
+    return controlWord;
+}
+
+boolean SequenceSearch::analyzeBlock()
+{
+    addresses.clear();
+    inputRegisters = 0;
+    inputAddresses = 0;
+
+    uint8_t writtenRegisters = 0;
+    uint8_t writtenAddresses = 0;
+
+    const std::vector<uint8_t> &code = block->code;
+
+    for (size_t position = 0; position < code.size(); position += 1 + infos[code[position]].operandBytes)
+    {
+        const InstructionInfo &info = infos[code[position]];
+
+        inputRegisters |= info.reads & ~writtenRegisters;
+        writtenRegisters |= info.writes;
+
+        if (!info.memoryOperand)
+            continue;
+
+        uint8_t address = code[position + 1] & DefaultCpuModel::AddressMask;
+
+        auto found = std::find(addresses.begin(), addresses.end(), address);
+        uint8_t index = found - addresses.begin();
+
+        if (found == addresses.end())
+        {
+            if (addresses.size() == MaxAddresses)
+                return false;
+
+            addresses.push_back(address);
+        }
+
+        if (info.memoryWrite)
+            writtenAddresses |= 1 << index;
+        else
+            inputAddresses |= (1 << index) & ~writtenAddresses;
+    }
+
+    return true;
+}
+
+std::vector<uint8_t> SequenceSearch::encode(const Sequence &sequence)
+{
+    std::vector<uint8_t> code;
+
+    for (uint8_t i = 0; i < sequence.length; i++)
+    {
+        const Symbol &symbol = alphabet[sequence.symbols[i]];
+
+        code.push_back(symbol.opcode);
+        if (symbol.bytes > 1)
+            code.push_back(symbol.operand);
+    }
+
+    return code;
+}
+
+void SequenceSearch::run(CpuEmulator &emulator, const std::vector<uint8_t> &code, const Input &input, Outcome &outcome)
+{
+    CpuEmulatorState state{};
+
+    state.registers[REG_A] = input.a;
+    state.registers[REG_B] = input.b;
+    state.registers[REG_FLAGS] = input.flags;
+    state.registers[REG_OUT] = input.out;
+    state.registers[REG_PC] = block->address;
+
+    for (size_t i = 0; i < code.size(); i++)
+        state.ram[(block->address + i) & DefaultCpuModel::AddressMask] = code[i];
+
+    for (size_t i = 0; i < addresses.size(); i++)
+        state.ram[addresses[i]] = input.ram[i];
+
+    emulator.setState(state);
+
+    // Run until the program counter is behind the code at the start of an instruction
+    uint8_t end = (block->address + code.size()) & DefaultCpuModel::AddressMask;
+    uint8_t instruction = NOP;
+    uint8_t step = 0;
+
+    uint32_t outputs = 0x811C9DC5;
+    uint32_t budget = (code.size() + 1) * DefaultCpuModel::MaxSteps;
+
+    for (uint32_t cycle = 0; cycle < budget; cycle++)
+    {
+        if ((step == 0 || step >= microcode.getInstructionSteps(instruction)) && emulator.getRegister(REG_PC) == end)
+            break;
+
+        if (clock(emulator, instruction, step) & C_OI)
+            outputs = (outputs ^ emulator.getRegister(REG_OUT)) * 0x01000193;
+    }
+
+    memset(&outcome, 0, sizeof(outcome));
+
+    outcome.a = emulator.getRegister(REG_A);
+    outcome.b = emulator.getRegister(REG_B);
+    outcome.flags = emulator.getRegister(REG_FLAGS);
+    outcome.outputs = outputs;
+
+    for (size_t i = 0; i < addresses.size(); i++)
+        outcome.ram[i] = emulator.getState().ram[addresses[i]];
+}
+
+boolean SequenceSearch::matches(const Outcome &outcome, const Outcome &target)
+{
+    // RAM and the output register are always visible, the registers only if they are read later
+    if (outcome.outputs != target.outputs || memcmp(outcome.ram, target.ram, sizeof(outcome.ram)) != 0)
+        return false;
+
+    if ((block->liveOut & USES_A) && outcome.a != target.a)
+        return false;
+
+    if ((block->liveOut & USES_B) && outcome.b != target.b)
+        return false;
+
+    return !(block->liveOut & USES_FLAGS) || outcome.flags == target.flags;
+}
+
+uint64_t SequenceSearch::fingerprint(const Outcome outcomes[], uint8_t count)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    auto add = [&](uint8_t value) { hash = (hash ^ value) * 0x100000001B3ULL; };
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const Outcome &outcome = outcomes[i];
+
+        add(outcome.a);
+        add(outcome.b);
+        add(outcome.flags);
+
+        for (uint8_t value : outcome.ram)
+            add(value);
+
+        for (uint8_t shift = 0; shift < 32; shift += 8)
+            add(outcome.outputs >> shift);
+    }
+
+    return hash;
+}
+
+boolean SequenceSearch::remember(uint64_t fingerprint, const Sequence &sequence)
+{
+    SeenShard &shard = seen[fingerprint % SeenShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto result = shard.fingerprints.emplace(fingerprint, sequence);
+    if (result.second)
+    {
+        memoized++;
+        return true;
+    }
+
+    // Equally long sequences take the same cycles, keep the one with the fewest bytes instead of the one whose thread came first
+    if (!isBetter(sequence, result.first->second))
+        return false;
+
+    result.first->second = sequence;
+    return true;
+}
+
+boolean SequenceSearch::isRemembered(uint64_t fingerprint, const Sequence &sequence)
+{
+    SeenShard &shard = seen[fingerprint % SeenShards];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    const Sequence &remembered = shard.fingerprints.at(fingerprint);
+    return remembered.length == sequence.length && std::equal(sequence.symbols, sequence.symbols + sequence.length, remembered.symbols);
+}
+
+SequenceSearch::Input SequenceSearch::randomInput(uint32_t seed)
+{
+    uint64_t state = seed;
+    uint64_t registers = splitMix(state);
+    uint64_t ram = splitMix(state);
+
+    Input input;
+    input.a = registers;
+    input.b = registers >> 8;
+    input.flags = (registers >> 16) & (DefaultCpuModel::FlagStates - 1);
+    input.out = registers >> 24;
+
+    for (uint8_t i = 0; i < MaxAddresses; i++)
+        input.ram[i] = ram >> (i * 8);
+
+    return input;
+}
+
+boolean SequenceSearch::verify(CpuEmulator &emulator, const std::vector<uint8_t> &code)
+{
+    // The slots are the inputs the block reads, registers first and then RAM addresses
+    std::vector<uint8_t> slots;
+
+    if (inputRegisters & USES_A) slots.push_back(0xFF);
+    if (inputRegisters & USES_B) slots.push_back(0xFE);
+
+    for (uint8_t i = 0; i < addresses.size(); i++)
+    {
+        if (inputAddresses & (1 << i))
+            slots.push_back(i);
+    }
+
+    // Try all values of up to two inputs with random values for the others, otherwise only random ones
+    boolean exhaustive = slots.size() <= 2;
+    uint32_t count = exhaustive ? 1 << (slots.size() * 8) : VerifyInputs;
+
+    Outcome outcome;
+    Outcome target;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        Input input = randomInput(i + 0x5EED);
+
+        for (uint8_t slot = 0; exhaustive && slot < slots.size(); slot++)
+        {
+            uint8_t value = i >> (slot * 8);
+
+            if (slots[slot] == 0xFF)
+                input.a = value;
+            else if (slots[slot] == 0xFE)
+                input.b = value;
+            else
+                input.ram[slots[slot]] = value;
+        }
+
+        run(emulator, block->code, input, target);
+        run(emulator, code, input, outcome);
+
+        if (!matches(outcome, target))
+            return false;
+    }
+
+    return true;
+}
+
+boolean SequenceSearch::isBetter(const Sequence &sequence, const Sequence &other)
+{
+    if (isCheaper(sequence.cycles, sequence.bytes, other.cycles, other.bytes))
+        return true;
+
+    if (isCheaper(other.cycles, other.bytes, sequence.cycles, sequence.bytes))
+        return false;
+
+    // Equally cheap matches are found in any order by the threads, so the result only depends on the sequence
+    return std::lexicographical_compare(sequence.symbols, sequence.symbols + sequence.length, other.symbols, other.symbols + other.length);
+}
+
+void SequenceSearch::offer(CpuEmulator &emulator, const Sequence &sequence)
+{
+    if (sequence.bytes > blockBytes || !isCheaper(sequence.cycles, sequence.bytes, blockCycles, blockBytes))
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(bestMutex);
+
+        if (found && !isBetter(sequence, best))
+            return;
+    }
+
+    if (!verify(emulator, encode(sequence)))
+    {
+        rejected++;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(bestMutex);
+
+    if (!found || isBetter(sequence, best))
+    {
+        best = sequence;
+        found = true;
+    }
+}
+
+void SequenceSearch::extend(const std::vector<Sequence> &frontier, std::vector<Sequence> &next, uint32_t maxBytes, uint32_t maxCycles)
+{
+    std::atomic<size_t> index{0};
+    std::mutex nextMutex;
+
+    std::vector<Candidate> candidates;
+
+    auto worker = [&]()
+    {
+        CpuEmulator emulator;
+        std::vector<Candidate> extended;
+        Outcome outcomes[TestInputs];
+
+        for (size_t i = index++; i < frontier.size(); i = index++)
+        {
+            for (uint8_t symbol = 0; symbol < alphabet.size(); symbol++)
+            {
+                Sequence candidate = frontier[i];
+                candidate.symbols[candidate.length++] = symbol;
+                candidate.cycles += alphabet[symbol].cycles;
+                candidate.bytes += alphabet[symbol].bytes;
+
+                if (candidate.bytes > maxBytes || candidate.cycles > maxCycles)
+                    continue;
+
+                std::vector<uint8_t> code = encode(candidate);
+                boolean match = true;
+
+                for (uint8_t test = 0; test < TestInputs; test++)
+                {
+                    run(emulator, code, tests[test], outcomes[test]);
+                    match = match && matches(outcomes[test], targets[test]);
+                }
+
+                explored++;
+
+                if (match)
+                    offer(emulator, candidate);
+
+                // Another sequence already led to the same state as cheaply, so this one doesn't add anything new
+                uint64_t state = fingerprint(outcomes, TestInputs);
+                if (remember(state, candidate))
+                    extended.push_back({state, candidate});
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(nextMutex);
+        candidates.insert(candidates.end(), extended.begin(), extended.end());
+    };
+
+    std::vector<std::thread> workers;
+    for (uint8_t i = 1; i < threads; i++)
+        workers.emplace_back(worker);
+
+    worker();
+
+    for (auto &thread : workers)
+        thread.join();
+
+    // A cheaper sequence found later may have replaced one for the same state, only the remembered ones get extended
+    for (auto &candidate : candidates)
+    {
+        if (isRemembered(candidate.fingerprint, candidate.sequence))
+            next.push_back(candidate.sequence);
+    }
+}
+
+boolean SequenceSearch::optimize(const SearchBlock &searchBlock, std::vector<uint8_t> &replacement)
+{
+    block = &searchBlock;
+    found = false;
+
+    if (!analyzeBlock())
+        return false;
+
+    getCost(block->code, blockCycles, blockBytes);
+
+    // Build the alphabet from all straight-line instructions which change anything, with the addresses of the block as operands
+    alphabet.clear();
+
+    for (auto &mnemonic : MNEMONICS)
+    {
+        const InstructionInfo &info = infos[mnemonic.opcode];
+        if (!info.straightLine || (info.writes == 0 && !info.outputs && !info.memoryWrite))
+            continue;
+
+        if (!info.memoryOperand)
+        {
+            alphabet.push_back({mnemonic.opcode, 0x00, (uint8_t)(1 + info.operandBytes), info.cycles});
+            continue;
+        }
+
+        for (uint8_t address : addresses)
+            alphabet.push_back({mnemonic.opcode, address, (uint8_t)(1 + info.operandBytes), info.cycles});
+    }
+
+    if (alphabet.empty())
+        return false;
+
+    uint8_t minCycles = 0xFF;
+    for (auto &symbol : alphabet)
+        minCycles = std::min(minCycles, symbol.cycles);
+
+    // The first test inputs are the extremes, the others random
+    CpuEmulator emulator;
+
+    for (uint8_t i = 0; i < TestInputs; i++)
+    {
+        tests[i] = randomInput(i);
+
+        if (i < 2)
+        {
+            uint8_t value = i == 0 ? 0x00 : 0xFF;
+
+            memset(&tests[i], value, sizeof(tests[i]));
+            tests[i].flags &= DefaultCpuModel::FlagStates - 1;
+        }
+
+        run(emulator, block->code, tests[i], targets[i]);
+    }
+
+    // Start with the empty sequence, every level extends the new states of the last one by a single instruction
+    Sequence empty{};
+    std::vector<Sequence> frontier{empty};
+    std::vector<Sequence> next;
+
+    Outcome outcomes[TestInputs];
+    boolean match = true;
+
+    for (uint8_t test = 0; test < TestInputs; test++)
+    {
+        run(emulator, {}, tests[test], outcomes[test]);
+        match = match && matches(outcomes[test], targets[test]);
+    }
+
+    remember(fingerprint(outcomes, TestInputs), empty);
+
+    if (match)
+        offer(emulator, empty);
+
+    for (uint8_t length = 1; length <= maxLength; length++)
+    {
+        uint32_t maxCycles = found ? best.cycles : blockCycles;
+
+        // Every longer sequence costs more than the best one found
+        if ((uint32_t)length * minCycles > maxCycles)
+            break;
+
+        next.clear();
+        extend(frontier, next, blockBytes, maxCycles);
+        frontier.swap(next);
+
+        if (frontier.empty() || frontier.size() > MaxFrontier)
+            break;
+    }
+
+    for (auto &shard : seen)
+        shard.fingerprints.clear();
+
+    if (!found)
+        return false;
+
+    replacement = encode(best);
+    return true;
+}
@@ -0,0 +1,232 @@
+/*
+ * Search for cheaper instruction sequences with the same effect as a block of
+ * straight-line code.
+ *
+ * The cost of an instruction is the number of clock cycles of its microcode
+ * and its size in bytes. Candidates are run on the emulated cpu, driven by the
+ * microcode like the cpu controller does, and checked against the original on
+ * a few test inputs first. Only the cheapest sequence which leaves a state on
+ * these inputs gets extended. A match is verified on all values of its inputs,
+ * or on random ones if there are too many of them.
+ */
+
+#ifndef SEQUENCE_SEARCH_H
+#define SEQUENCE_SEARCH_H
+
+#include <CpuEmulator.h>
+#include <CpuMicrocode.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Bits of the registers an instruction reads or writes. */
+enum RegisterBits
+{
+    USES_A = 0x01,
+    USES_B = 0x02,
+    USES_FLAGS = 0x04,
+    USES_ALL = 0x07
+};
+
+/* What an instruction does, read from the control words of its microcode. */
+struct InstructionInfo
+{
+    const char *name;       // The mnemonic from CpuDefinitions.h or nullptr if the opcode isn't defined
+    uint8_t operandBytes;   // Bytes after the opcode read through the program counter
+    uint8_t cycles;         // Clock cycles before the step counter wraps around
+    uint8_t reads;          // RegisterBits used before the instruction writes any
+    uint8_t writes;         // RegisterBits loaded by the instruction
+    boolean jumps;          // Loads the program counter from the operand in any flag table
+    boolean conditional;    // The microcode depends on the flags
+    boolean halts;          // Stops the clock
+    boolean outputs;        // Loads the output register
+    boolean memoryOperand;  // The operand is a RAM address
+    boolean memoryWrite;    // Writes to the RAM address of the operand
+    boolean straightLine;   // Continues with the next instruction and can be part of a block
+};
+
+/* A block of straight-line code and the registers which are read after it. */
+struct SearchBlock
+{
+    uint8_t address;
+    std::vector<uint8_t> code;
+    uint8_t liveOut;
+};
+
+/* Class which searches the cheapest replacement of straight-line blocks. */
+class SequenceSearch
+{
+public:
+
+    /* The longest sequence which can be searched. */
+    static const uint8_t MaxLength = 0x08;
+
+    /* The most RAM addresses a block can use. */
+    static const uint8_t MaxAddresses = 0x08;
+
+    /* The number of test inputs every candidate runs on. */
+    static const uint8_t TestInputs = 0x08;
+
+    /* The number of inputs a match gets verified on when they can't all be tried. */
+    static const uint32_t VerifyInputs = 0x10000;
+
+    /* A level of the search stops deepening when it has more sequences than this. */
+    static const uint32_t MaxFrontier = 0x200000;
+
+    SequenceSearch(CpuMicrocode &microcode, uint8_t maxLength, uint8_t threads);
+
+    /* Returns what the given opcode does. */
+    const InstructionInfo &getInfo(uint8_t opcode) { return infos[opcode]; }
+
+    /* Returns the clock cycles and bytes of the given straight-line code. */
+    void getCost(const std::vector<uint8_t> &code, uint32_t &cycles, uint32_t &bytes);
+
+    /* This searches for a cheaper sequence with the same effect as the block, returns false if there is none. */
+    boolean optimize(const SearchBlock &block, std::vector<uint8_t> &replacement);
+
+    /* Returns the number of candidates run during all searches. */
+    uint64_t getExplored() { return explored; }
+
+    /* Returns the number of different states the explored sequences were reduced to. */
+    uint64_t getMemoized() { return memoized; }
+
+    /* Returns the number of matches which failed the verification. */
+    uint32_t getRejected() { return rejected; }
+
+    /* This clocks the emulated cpu once like the cpu controller does and returns the executed control word.
+     * The instruction and step are the ones of the controller and get updated. */
+    CpuMicrocode::ControlWord clock(CpuEmulator &emulator, uint8_t &instruction, uint8_t &step);
+
+    /* Returns the instruction at the given address as text. */
+    std::string disassemble(const std::vector<uint8_t> &code, uint8_t address);
+
+private:
+
+    /* An instruction of the alphabet candidates are built from. */
+    struct Symbol
+    {
+        uint8_t opcode;
+        uint8_t operand;
+        uint8_t bytes;
+        uint8_t cycles;
+    };
+
+    /* A candidate as indices into the alphabet. */
+    struct Sequence
+    {
+        uint8_t length;
+        uint8_t symbols[MaxLength];
+        uint16_t cycles;
+        uint8_t bytes;
+    };
+
+    /* The registers and RAM the code starts with. */
+    struct Input
+    {
+        uint8_t a, b, flags, out;
+        uint8_t ram[MaxAddresses];
+    };
+
+    /* The registers and RAM after the code, the values written to the output register are hashed. */
+    struct Outcome
+    {
+        uint8_t a, b, flags;
+        uint8_t ram[MaxAddresses];
+        uint32_t outputs;
+    };
+
+    /* A candidate and the hash of its outcomes on the test inputs. */
+    struct Candidate
+    {
+        uint64_t fingerprint;
+        Sequence sequence;
+    };
+
+    /* One part of the explored states with the cheapest sequence leading to each, so threads rarely wait for each other. */
+    struct SeenShard
+    {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, Sequence> fingerprints;
+    };
+
+    static const uint8_t SeenShards = 0x40;
+
+    CpuMicrocode &microcode;
+    uint8_t maxLength;
+    uint8_t threads;
+
+    InstructionInfo infos[0x100];
+
+    /* The state of the current search. */
+    const SearchBlock *block = nullptr;
+    std::vector<uint8_t> addresses;
+    std::vector<Symbol> alphabet;
+    Input tests[TestInputs];
+    Outcome targets[TestInputs];
+    uint32_t blockCycles = 0;
+    uint32_t blockBytes = 0;
+
+    /* The registers and RAM addresses the block reads before writing them. */
+    uint8_t inputRegisters = 0;
+    uint8_t inputAddresses = 0;
+
+    SeenShard seen[SeenShards];
+
+    std::mutex bestMutex;
+    boolean found = false;
+    Sequence best;
+
+    std::atomic<uint64_t> explored{0};
+    std::atomic<uint64_t> memoized{0};
+    std::atomic<uint32_t> rejected{0};
+
+    /* This reads the properties of all defined opcodes from the microcode. */
+    void analyzeMicrocode();
+
+    /* This collects the RAM addresses and the inputs the block reads before writing them. */
+    boolean analyzeBlock();
+
+    /* Returns the bytes of the given candidate. */
+    std::vector<uint8_t> encode(const Sequence &sequence);
+
+    /* This runs the code placed at the block address on the given input. */
+    void run(CpuEmulator &emulator, const std::vector<uint8_t> &code, const Input &input, Outcome &outcome);
+
+    /* Returns if the first sequence is cheaper than the second one. */
+    static boolean isCheaper(uint32_t cycles, uint32_t bytes, uint32_t otherCycles, uint32_t otherBytes)
+    {
+        return cycles < otherCycles || (cycles == otherCycles && bytes < otherBytes);
+    }
+
+    /* Returns if the first candidate is cheaper or equally cheap and first in order. */
+    static boolean isBetter(const Sequence &sequence, const Sequence &other);
+
+    /* Returns if the outcomes agree on everything which is used after the block. */
+    boolean matches(const Outcome &outcome, const Outcome &target);
+
+    /* Returns a hash of all outcomes of a candidate on the test inputs. */
+    static uint64_t fingerprint(const Outcome outcomes[], uint8_t count);
+
+    /* Returns true and remembers the sequence if no other sequence led to the same state as cheaply before. */
+    boolean remember(uint64_t fingerprint, const Sequence &sequence);
+
+    /* Returns if the given sequence is the one remembered for the state. */
+    boolean isRemembered(uint64_t fingerprint, const Sequence &sequence);
+
+    /* This runs the candidate on all or random values of its inputs and returns if it always matches the block. */
+    boolean verify(CpuEmulator &emulator, const std::vector<uint8_t> &code);
+
+    /* Returns a random input with the given seed. */
+    Input randomInput(uint32_t seed);
+
+    /* This extends the given sequences by every symbol and collects the cheapest one leading to each new state. */
+    void extend(const std::vector<Sequence> &frontier, std::vector<Sequence> &next, uint32_t maxBytes, uint32_t maxCycles);
+
+    /* This checks a candidate which matched the test inputs and keeps it if it is the cheapest so far. */
+    void offer(CpuEmulator &emulator, const Sequence &sequence);
+};
+
+#endif
@@ -0,0 +1,586 @@
+/*
+ * Superoptimizer for programs of the cpu.
+ *
+ * Takes a program as posted to /code and replaces every block of straight-line
+ * code with the cheapest equivalent instruction sequence found. The cost is
+ * taken from the built in microcode: the clock cycles of each instruction and
+ * then its size in bytes. Registers which are overwritten before they are read
+ * again don't need to match, RAM and the output register always do. The blocks
+ * are searched on all cores, the optimized program is moved together, its jumps
+ * are fixed up and it gets compared with the original on the virtual cpu.
+ *
+ * Run with: pio run -e superopt
+ * and then: .pio/build/superopt/program program.json [max length] [threads]
+ * The program is a json array of bytes or any list of decimal and hex numbers,
+ * - reads it from stdin. The optimized program is printed as json array.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SequenceSearch.h"
+
+/* The clock cycles the whole program may run when it gets compared with the optimized one. */
+static const uint32_t PROGRAM_BUDGET = 1000000;
+
+/* The number of values written to the output register which are compared. */
+static const uint32_t MAX_OUTPUTS = 0x1000;
+
+/* The instructions of a program, found by following all paths from address zero. */
+struct Program
+{
+    std::vector<uint8_t> code;
+    boolean isCode[0x100];
+    boolean isStart[0x100];
+    boolean isLeader[0x100];
+    uint8_t liveIn[0x100];
+    uint8_t liveOut[0x100];
+};
+
+/* The observable behaviour of a program on the virtual cpu. */
+struct ProgramRun
+{
+    std::vector<uint8_t> outputs;
+    std::vector<uint32_t> outputCycles;
+    boolean halted = false;
+    uint32_t cycles = 0;
+    CpuEmulatorState state;
+};
+
+/* This reads all numbers from the given file and returns false if one isn't a byte or there are too many. */
+static boolean readProgram(const char *path, std::vector<uint8_t> &code)
+{
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Can't open %s\n", path);
+        return false;
+    }
+
+    std::string text;
+    char buffer[0x400];
+    size_t read;
+
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, read);
+
+    if (file != stdin)
+        fclose(file);
+
+    // Everything which isn't part of a number separates them, like brackets and commas of a json array
+    const char *position = text.c_str();
+
+    while (*position != '\0')
+    {
+        if (*position == '-' && isdigit((unsigned char)position[1]))
+        {
+            fprintf(stderr, "The program can't contain negative numbers\n");
+            return false;
+        }
+
+        if (!isdigit((unsigned char)*position))
+        {
+            position++;
+            continue;
+        }
+
+        // Hex numbers need their prefix, a leading zero doesn't make a number octal
+        boolean hex = position[0] == '0' && (position[1] == 'x' || position[1] == 'X') && isxdigit((unsigned char)position[2]);
+
+        char *end;
+        long value = hex ? strtol(position + 2, &end, 16) : strtol(position, &end, 10);
+
+        if (value > 0xFF || code.size() == DefaultCpuModel::MaxCodeSize)
+        {
+            fprintf(stderr, "The program has to consist of up to %u bytes\n", DefaultCpuModel::MaxCodeSize);
+            return false;
+        }
+
+        code.push_back(value);
+        position = end;
+    }
+
+    return !code.empty();
+}
+
+/* This finds all instructions reachable from address zero and returns false if the program can't be optimized safely. */
+static boolean analyzeProgram(SequenceSearch &search, Program &program)
+{
+    const std::vector<uint8_t> &code = program.code;
+
+    memset(program.isCode, 0, sizeof(program.isCode));
+    memset(program.isStart, 0, sizeof(program.isStart));
+    memset(program.isLeader, 0, sizeof(program.isLeader));
+
+    std::vector<uint8_t> pending{0x00};
+    program.isLeader[0x00] = true;
+
+    while (!pending.empty())
+    {
+        uint8_t address = pending.back();
+        pending.pop_back();
+
+        if (program.isStart[address])
+            continue;
+
+        if (address >= code.size())
+        {
+            fprintf(stderr, "The program runs past its end at 0x%02X, end it with HLT or JMP\n", address);
+            return false;
+        }
+
+        const InstructionInfo &info = search.getInfo(code[address]);
+        if (info.name == nullptr)
+        {
+            fprintf(stderr, "Unknown opcode 0x%02X at 0x%02X\n", code[address], address);
+            return false;
+        }
+
+        for (uint8_t i = 0; i <= info.operandBytes; i++)
+        {
+            if (address + i >= code.size() || program.isCode[address + i])
+            {
+                fprintf(stderr, "The instruction at 0x%02X overlaps another one or the end of the program\n", address);
+                return false;
+            }
+
+            program.isCode[address + i] = true;
+        }
+
+        program.isStart[address] = true;
+
+        uint8_t next = address + 1 + info.operandBytes;
+
+        if (info.jumps)
+        {
+            uint8_t target = code[address + 1] & DefaultCpuModel::AddressMask;
+
+            program.isLeader[target] = true;
+            pending.push_back(target);
+        }
+
+        // Unconditional jumps and halts don't continue with the next instruction
+        if ((info.jumps && !info.conditional) || info.halts)
+            continue;
+
+        if (!info.straightLine)
+            program.isLeader[next] = true;
+
+        pending.push_back(next);
+    }
+
+    // Jumps have to land on instructions and no instruction may use the program as data
+    for (uint16_t address = 0; address < code.size(); address++)
+    {
+        if (program.isLeader[address] && !program.isStart[address] && program.isCode[address])
+        {
+            fprintf(stderr, "A jump lands inside the instruction at 0x%02X\n", address);
+            return false;
+        }
+
+        if (!program.isStart[address] || !search.getInfo(code[address]).memoryOperand)
+            continue;
+
+        uint8_t operand = code[address + 1] & DefaultCpuModel::AddressMask;
+        if (operand < code.size() && program.isCode[operand])
+        {
+            fprintf(stderr, "The instruction at 0x%02X uses the code at 0x%02X as data\n", address, operand);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* This computes which registers are read before they get written after each instruction. */
+static void analyzeLiveness(SequenceSearch &search, Program &program)
+{
+    const std::vector<uint8_t> &code = program.code;
+
+    memset(program.liveIn, 0, sizeof(program.liveIn));
+    memset(program.liveOut, 0, sizeof(program.liveOut));
+
+    // Go backwards until nothing changes, a halt or paging shows all registers to the outside
+    boolean changed = true;
+
+    while (changed)
+    {
+        changed = false;
+
+        for (int16_t address = code.size() - 1; address >= 0; address--)
+        {
+            if (!program.isStart[address])
+                continue;
+
+            const InstructionInfo &info = search.getInfo(code[address]);
+            uint8_t next = address + 1 + info.operandBytes;
+            uint8_t liveOut = 0;
+
+            if (info.halts || code[address] == PAG)
+                liveOut = USES_ALL;
+
+            if (info.jumps)
+                liveOut |= program.liveIn[code[address + 1] & DefaultCpuModel::AddressMask];
+
+            if ((!info.jumps || info.conditional) && !info.halts)
+                liveOut |= program.liveIn[next];
+
+            uint8_t liveIn = info.reads | (liveOut & ~info.writes);
+
+            if (liveOut != program.liveOut[address] || liveIn != program.liveIn[address])
+            {
+                program.liveOut[address] = liveOut;
+                program.liveIn[address] = liveIn;
+                changed = true;
+            }
+        }
+    }
+}
+
+/* This collects the blocks of straight-line code, a block ends before a jump target and with a jump, halt or paging. */
+static std::vector<SearchBlock> findBlocks(SequenceSearch &search, Program &program)
+{
+    std::vector<SearchBlock> blocks;
+    const std::vector<uint8_t> &code = program.code;
+
+    for (uint16_t address = 0; address < code.size();)
+    {
+        if (!program.isStart[address] || !search.getInfo(code[address]).straightLine)
+        {
+            address++;
+            continue;
+        }
+
+        SearchBlock block{(uint8_t)address, {}, 0};
+        uint8_t last = address;
+
+        do
+        {
+            uint8_t size = 1 + search.getInfo(code[address]).operandBytes;
+
+            block.code.insert(block.code.end(), code.begin() + address, code.begin() + address + size);
+            last = address;
+            address += size;
+        } while (address < code.size() && program.isStart[address] && !program.isLeader[address] && search.getInfo(code[address]).straightLine);
+
+        block.liveOut = program.liveOut[last];
+        blocks.push_back(block);
+    }
+
+    return blocks;
+}
+
+/* This searches a replacement of the whole block and, if there is none, of every window of instructions inside it.
+ * The windows start with the longest ones and the search repeats on the changed code, returns false if nothing got cheaper. */
+static boolean optimizeBlock(SequenceSearch &search, const SearchBlock &block, uint8_t maxLength, std::vector<uint8_t> &replacement)
+{
+    if (search.optimize(block, replacement))
+        return true;
+
+    std::vector<uint8_t> code = block.code;
+    boolean changed = true;
+    boolean improved = false;
+
+    while (changed)
+    {
+        changed = false;
+
+        // Find the instructions and the registers read after each of them inside the block
+        std::vector<uint8_t> starts;
+        for (size_t address = 0; address < code.size(); address += 1 + search.getInfo(code[address]).operandBytes)
+            starts.push_back(address);
+
+        std::vector<uint8_t> liveAfter(starts.size());
+        uint8_t live = block.liveOut;
+
+        for (int16_t i = starts.size() - 1; i >= 0; i--)
+        {
+            const InstructionInfo &info = search.getInfo(code[starts[i]]);
+
+            liveAfter[i] = live;
+            live = info.reads | (live & ~info.writes);
+        }
+
+        // A window is at most one instruction longer than the sequences searched and shorter than the block
+        size_t maxWindow = std::min(starts.size() - 1, (size_t)maxLength + 1);
+
+        for (size_t length = maxWindow; length >= 2 && !changed; length--)
+        {
+            for (size_t first = 0; first + length <= starts.size() && !changed; first++)
+            {
+                size_t begin = starts[first];
+                size_t end = first + length < starts.size() ? starts[first + length] : code.size();
+
+                SearchBlock window{(uint8_t)(block.address + begin), {code.begin() + begin, code.begin() + end}, liveAfter[first + length - 1]};
+                std::vector<uint8_t> windowReplacement;
+
+                if (!search.optimize(window, windowReplacement))
+                    continue;
+
+                code.erase(code.begin() + begin, code.begin() + end);
+                code.insert(code.begin() + begin, windowReplacement.begin(), windowReplacement.end());
+
+                changed = true;
+                improved = true;
+            }
+        }
+    }
+
+    if (improved)
+        replacement = code;
+
+    return improved;
+}
+
+/* Returns the instructions of the given code as text. */
+static std::string listing(SequenceSearch &search, const std::vector<uint8_t> &code)
+{
+    std::string text;
+
+    for (size_t address = 0; address < code.size(); address += 1 + search.getInfo(code[address]).operandBytes)
+        text += (text.empty() ? "" : "; ") + search.disassemble(code, address);
+
+    return text.empty() ? "(nothing)" : text;
+}
+
+/* This puts the replacements into the program, moves the following code of the same run together and fixes the jumps.
+ * Data outside of the code keeps its address, the bytes freed at the end of a run become NOPs. */
+static std::vector<uint8_t> relocate(SequenceSearch &search, Program &program, const std::vector<SearchBlock> &blocks,
+                                     const std::vector<std::vector<uint8_t>> &replacements, const std::vector<bool> &replaced)
+{
+    const std::vector<uint8_t> &code = program.code;
+    std::vector<uint8_t> optimized = code;
+
+    uint8_t newAddress[0x100];
+    std::vector<std::pair<uint8_t, uint8_t>> jumps;
+
+    for (uint16_t start = 0; start < code.size();)
+    {
+        if (!program.isCode[start])
+        {
+            start++;
+            continue;
+        }
+
+        uint16_t position = start;
+        uint16_t address = start;
+
+        while (address < code.size() && program.isCode[address])
+        {
+            newAddress[address] = position;
+
+            auto block = std::find_if(blocks.begin(), blocks.end(), [&](const SearchBlock &b) { return b.address == address; });
+            if (block != blocks.end() && replaced[block - blocks.begin()])
+            {
+                const std::vector<uint8_t> &replacement = replacements[block - blocks.begin()];
+
+                std::copy(replacement.begin(), replacement.end(), optimized.begin() + position);
+                position += replacement.size();
+                address += block->code.size();
+                continue;
+            }
+
+            const InstructionInfo &info = search.getInfo(code[address]);
+            uint8_t size = 1 + info.operandBytes;
+
+            std::copy(code.begin() + address, code.begin() + address + size, optimized.begin() + position);
+
+            if (info.jumps)
+                jumps.push_back({position + 1, code[address + 1] & DefaultCpuModel::AddressMask});
+
+            position += size;
+            address += size;
+        }
+
+        std::fill(optimized.begin() + position, optimized.begin() + address, NOP);
+        start = address;
+    }
+
+    for (auto &jump : jumps)
+        optimized[jump.first] = newAddress[jump.second];
+
+    return optimized;
+}
+
+/* This runs the program on the virtual cpu until it halts or the budget is used up. */
+static void runProgram(SequenceSearch &search, CpuEmulator &emulator, const std::vector<uint8_t> &code, ProgramRun &run)
+{
+    CpuEmulatorState state{};
+    std::copy(code.begin(), code.end(), state.ram);
+
+    emulator.setState(state);
+
+    uint8_t instruction = NOP;
+    uint8_t step = 0;
+
+    for (run.cycles = 0; run.cycles < PROGRAM_BUDGET; run.cycles++)
+    {
+        CpuMicrocode::ControlWord controlWord = search.clock(emulator, instruction, step);
+
+        // The halt signal stops the clock with this cycle
+        if (controlWord & C_HLT)
+        {
+            run.halted = true;
+            run.cycles++;
+            break;
+        }
+
+        if ((controlWord & C_OI) && run.outputs.size() < MAX_OUTPUTS)
+        {
+            run.outputs.push_back(emulator.getRegister(REG_OUT));
+            run.outputCycles.push_back(run.cycles + 1);
+        }
+    }
+
+    run.state = emulator.getState();
+}
+
+/* This compares both runs and returns false if they behave differently. */
+static boolean compareRuns(Program &program, const ProgramRun &original, const ProgramRun &optimized)
+{
+    // A program which doesn't halt gets compared on the outputs both runs got to
+    size_t outputs = std::min(original.outputs.size(), optimized.outputs.size());
+
+    if (!std::equal(original.outputs.begin(), original.outputs.begin() + outputs, optimized.outputs.begin()))
+        return false;
+
+    // Halting within the budget when the original doesn't is a different behaviour as well
+    if (original.halted != optimized.halted)
+        return false;
+
+    if (!original.halted)
+        return true;
+
+    if (original.outputs.size() != optimized.outputs.size())
+        return false;
+
+    for (CpuRegister reg : {REG_A, REG_B, REG_FLAGS, REG_OUT})
+    {
+        if (original.state.registers[reg] != optimized.state.registers[reg])
+            return false;
+    }
+
+    // The data keeps its address, only the code may differ
+    for (uint16_t address = 0; address < DefaultCpuModel::RamSize; address++)
+    {
+        if (!program.isCode[address] && original.state.ram[address] != optimized.state.ram[address])
+            return false;
+    }
+
+    return true;
+}
+
+/* This parses a positive decimal argument, larger values are clamped to the given maximum. Returns false if it isn't a number. */
+static boolean parseCount(const char *text, long maximum, uint8_t &count)
+{
+    char *end;
+    long value = strtol(text, &end, 10);
+
+    if (!isdigit((unsigned char)*text) || *end != '\0' || value < 1)
+        return false;
+
+    count = std::min(value, maximum);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    uint8_t maxLength = 4;
+    uint8_t threads = std::min(std::max(std::thread::hardware_concurrency(), 1u), 0xFFu);
+
+    if (argc < 2 || (argc > 2 && !parseCount(argv[2], SequenceSearch::MaxLength, maxLength)) || (argc > 3 && !parseCount(argv[3], 0xFF, threads)))
+    {
+        fprintf(stderr, "Usage: %s <program file or -> [max length] [threads]\n", argv[0]);
+        return 2;
+    }
+
+    CpuMicrocode microcode;
+    microcode.init();
+
+    SequenceSearch search(microcode, maxLength, threads);
+
+    Program program;
+    if (!readProgram(argv[1], program.code) || !analyzeProgram(search, program))
+        return 1;
+
+    analyzeLiveness(search, program);
+
+    std::vector<SearchBlock> blocks = findBlocks(search, program);
+    std::vector<std::vector<uint8_t>> replacements(blocks.size());
+    std::vector<bool> replaced(blocks.size());
+
+    printf("program: %zu bytes, %zu blocks, searching up to %u instructions on %u threads\n", program.code.size(), blocks.size(),
+           maxLength, threads);
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        SearchBlock &block = blocks[i];
+
+        uint32_t cycles, bytes;
+        search.getCost(block.code, cycles, bytes);
+
+        printf("\n0x%02X: %s\n  %u cycles, %u bytes\n", block.address, listing(search, block.code).c_str(), cycles, bytes);
+
+        replaced[i] = optimizeBlock(search, block, maxLength, replacements[i]);
+
+        if (!replaced[i])
+        {
+            printf("  no cheaper sequence\n");
+            continue;
+        }
+
+        uint32_t newCycles, newBytes;
+        search.getCost(replacements[i], newCycles, newBytes);
+
+        printf("  -> %s\n  %u cycles, %u bytes\n", listing(search, replacements[i]).c_str(), newCycles, newBytes);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("\nsearch: %.2f s, %llu sequences run, %llu different states, %u matches rejected by verification\n", seconds,
+           (unsigned long long)search.getExplored(), (unsigned long long)search.getMemoized(), search.getRejected());
+
+    std::vector<uint8_t> optimized = relocate(search, program, blocks, replacements, replaced);
+
+    // Check the whole program on the virtual cpu, the blocks were only verified on their own
+    CpuEmulator emulator;
+    ProgramRun originalRun;
+    ProgramRun optimizedRun;
+
+    runProgram(search, emulator, program.code, originalRun);
+    runProgram(search, emulator, optimized, optimizedRun);
+
+    if (!compareRuns(program, originalRun, optimizedRun))
+    {
+        fprintf(stderr, "The optimized program behaves differently, keeping the original\n");
+        optimized = program.code;
+    }
+    else if (originalRun.halted && optimizedRun.halted)
+    {
+        printf("program: %u -> %u cycles until halt\n", originalRun.cycles, optimizedRun.cycles);
+    }
+    else if (!optimizedRun.outputs.empty() && !originalRun.outputs.empty())
+    {
+        size_t outputs = std::min(originalRun.outputs.size(), optimizedRun.outputs.size());
+
+        printf("program: %u -> %u cycles until output %zu\n", originalRun.outputCycles[outputs - 1], optimizedRun.outputCycles[outputs - 1],
+               outputs);
+    }
+
+    printf("\n[");
+    for (size_t i = 0; i < optimized.size(); i++)
+        printf("%s%u", i > 0 ? "," : "", optimized[i]);
+
+    printf("]\n");
+
+    return 0;
+}